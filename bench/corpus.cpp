@@ -0,0 +1,184 @@
+#include "corpus.h"
+
+#include <array>
+#include <random>
+#include <cstdio>
+
+namespace {
+    constexpr std::array words = {
+        "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+        "india", "juliet", "kilo", "lima", "mike", "november", "oscar", "papa",
+    };
+
+    template <typename Random>
+    const char *word(Random &random) {
+        return words[random() % words.size()];
+    }
+
+    template <typename Random>
+    void jsonValue(std::string &text, Random &random, size_t depth) {
+        switch (random() % (depth < 3 ? 7 : 4)) {
+            case 0:
+                text += '"';
+                text += word(random);
+                text += '"';
+                break;
+            case 1:
+                text += std::to_string(static_cast<int64_t>(random() % 200000) - 100000);
+                break;
+            case 2:
+                text += std::to_string(random() % 1000) + "." + std::to_string(random() % 1000) + "e-3";
+                break;
+            case 3:
+                text += std::array { "true", "false", "null" }[random() % 3];
+                break;
+            case 4:
+            case 5: {
+                text += "{ ";
+
+                size_t count = random() % 5;
+
+                for (size_t a = 0; a < count; a++) {
+                    text += a ? ", \"" : "\"";
+                    text += word(random);
+                    text += "\": ";
+
+                    jsonValue(text, random, depth + 1);
+                }
+
+                text += " }";
+                break;
+            }
+            default: {
+                text += "[";
+
+                size_t count = random() % 6;
+
+                for (size_t a = 0; a < count; a++) {
+                    text += a ? ", " : "";
+
+                    jsonValue(text, random, depth + 1);
+                }
+
+                text += "]";
+                break;
+            }
+        }
+    }
+
+    template <typename Random>
+    void expression(std::string &text, Random &random, size_t depth) {
+        size_t count = 1 + random() % 4;
+
+        for (size_t a = 0; a < count; a++) {
+            if (a)
+                text += std::array { " + ", " - ", " * ", " / " }[random() % 4];
+
+            if (depth < 4 && random() % 3 == 0) {
+                text += "(";
+                expression(text, random, depth + 1);
+                text += ")";
+            } else {
+                text += std::to_string(1 + random() % 1000);
+            }
+        }
+    }
+}
+
+std::string generateJson(size_t size, uint32_t seed) {
+    std::mt19937 random(seed);
+
+    std::string text = "[\n";
+    text.reserve(size + 1024);
+
+    while (text.size() < size) {
+        text += text.size() > 2 ? ",\n  { \"id\": " : "  { \"id\": ";
+        text += std::to_string(random() % 1000000);
+        text += ", \"name\": \"";
+        text += word(random);
+        text += "\", \"data\": ";
+
+        jsonValue(text, random, 0);
+
+        text += " }";
+    }
+
+    text += "\n]\n";
+
+    return text;
+}
+
+std::string generateExpressions(size_t size, uint32_t seed) {
+    std::mt19937 random(seed);
+
+    std::string text;
+    text.reserve(size + 1024);
+
+    while (text.size() < size) {
+        expression(text, random, 0);
+        text += ";\n";
+    }
+
+    return text;
+}
+
+std::string generateLog(size_t size, uint32_t seed) {
+    std::mt19937 random(seed);
+
+    constexpr std::array levels = { "DEBUG", "INFO", "INFO", "INFO", "WARN", "ERROR" };
+
+    std::string text;
+    text.reserve(size + 1024);
+
+    char stamp[32];
+
+    for (uint64_t line = 0; text.size() < size; line++) {
+        uint64_t millis = line * 137;
+
+        std::snprintf(stamp, sizeof(stamp), "2024-03-%02uT%02u:%02u:%02u.%03uZ",
+            static_cast<unsigned>(1 + millis / 86400000 % 28), static_cast<unsigned>(millis / 3600000 % 24),
+            static_cast<unsigned>(millis / 60000 % 60), static_cast<unsigned>(millis / 1000 % 60),
+            static_cast<unsigned>(millis % 1000));
+
+        text += stamp;
+        text += ' ';
+        text += levels[random() % levels.size()];
+        text += " [";
+        text += word(random);
+        text += "]";
+
+        size_t count = 3 + random() % 10;
+
+        for (size_t a = 0; a < count; a++) {
+            text += ' ';
+            text += word(random);
+        }
+
+        text += '\n';
+    }
+
+    return text;
+}
+
+std::string generateRecords(size_t size, uint32_t seed) {
+    std::mt19937 random(seed);
+
+    std::string text;
+    text.reserve(size + 1024);
+
+    while (text.size() < size) {
+        for (size_t a = 0; a < 16; a++) {
+            if (a > 0)
+                text += ',';
+
+            if (random() % 2)
+                text += word(random);
+            else
+                text += std::to_string(random() % 100000);
+        }
+
+        text += '\n';
+    }
+
+    return text;
+}
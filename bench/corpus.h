@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+// Deterministic inputs for crimson_bench, each about size bytes of whole records. The same size and seed
+// always give the same text, so numbers from different builds compare.
+
+// A JSON array of objects with strings, numbers, literals, nested objects and arrays.
+std::string generateJson(size_t size, uint32_t seed = 42);
+
+// Statements like "(3 + 41) * 7 - 2 / (5 + 1);" nested a few levels deep.
+std::string generateExpressions(size_t size, uint32_t seed = 42);
+
+// Log lines like "2024-03-01T12:00:00.000Z INFO [net] message words".
+std::string generateLog(size_t size, uint32_t seed = 42);
+
+// Records of 16 comma separated fields per line, words and numbers, like "kilo,42,papa,...".
+std::string generateRecords(size_t size, uint32_t seed = 42);
@@ -0,0 +1,430 @@
+#include "corpus.h"
+
+#include <crimson/program.h>
+
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <charconv>
+#include <functional>
+
+#include <sys/resource.h>
+
+// Parses generated corpora with representative grammars and prints one JSON object per grammar and size:
+//   crimson_bench [sizes] [grammars] [seconds]
+// sizes is a comma separated list with K, M or G suffixes (default 1K,64K,1M,16M, up to 1G),
+// grammars a comma separated subset of json, json-vm, expression, expression-vm, operators, log and records, where the
+// -vm variants run the same grammar compiled for the iterative VM of program.h. Every case repeats until it ran for
+// about seconds (default 0.5), allocations are counted per parse and peak RSS is for the whole process so far.
+// A first line reports how many times each value is copied or moved while a 16 component Rule builds its result.
+
+namespace {
+    std::atomic<size_t> allocations = 0;
+    std::atomic<size_t> allocated = 0;
+}
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated.fetch_add(size, std::memory_order_relaxed);
+
+    if (void *pointer = std::malloc(size ? size : 1))
+        return pointer;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+namespace {
+    // Room for a recursive rule, Wraps can point at it before the rule it holds is built.
+    template <typename ...Produces>
+    struct Recursive {
+        alignas(AnyRule<Produces...>) std::byte storage[sizeof(AnyRule<Produces...>)];
+        bool defined = false;
+
+        const AnyRule<Produces...> *get() const {
+            return reinterpret_cast<const AnyRule<Produces...> *>(storage);
+        }
+
+        auto wrap() const {
+            return Wrap<Produces...>(get());
+        }
+
+        template <typename T>
+        void define(T &&rule) {
+            new (storage) AnyRule<Produces...>(std::forward<T>(rule));
+            defined = true;
+        }
+
+        Recursive() = default;
+        Recursive(const Recursive &other) = delete;
+
+        ~Recursive() {
+            if (defined)
+                std::launder(reinterpret_cast<AnyRule<Produces...> *>(storage))->~AnyRule();
+        }
+    };
+
+    size_t sum(const std::vector<size_t> &values) {
+        size_t total = 0;
+
+        for (auto value : values)
+            total += value;
+
+        return total;
+    }
+
+    // Counts nodes of a JSON document, through the tree of rules or compiled into a program.
+    struct JsonGrammar {
+        Recursive<size_t> value;
+        std::optional<Program<std::tuple<size_t>>> program;
+
+        AnyHard token = AnyHard({ ',', ':', '{', '}', '[', ']', '"' });
+
+        explicit JsonGrammar(bool compiled) {
+            auto string = [] {
+                return Rule(Text("\""), UntilView({ "\"" }), Text("\"")).map([](auto) -> size_t { return 1; });
+            };
+
+            auto member = [this, &string] {
+                return Rule(string(), Text(":"), value.wrap())
+                    .map([](auto tuple) { return std::get<0>(tuple) + std::get<1>(tuple); });
+            };
+
+            auto members = Rule(member(), Rule(Text(","), member()).many())
+                .map([](auto tuple) { return std::get<0>(tuple) + sum(std::get<1>(tuple)); });
+
+            auto object = Rule(Text("{"), std::move(members).maybe(), Text("}"))
+                .map([](auto tuple) { return 1 + std::get<0>(tuple).value_or(0); });
+
+            auto elements = Rule(value.wrap(), Rule(Text(","), value.wrap()).many())
+                .map([](auto tuple) { return std::get<0>(tuple) + sum(std::get<1>(tuple)); });
+
+            auto array = Rule(Text("["), std::move(elements).maybe(), Text("]"))
+                .map([](auto tuple) { return 1 + std::get<0>(tuple).value_or(0); });
+
+            auto literal = [](const char *text) {
+                return Rule(Text(text)).map([](auto) -> size_t { return 1; });
+            };
+
+            auto number = Rule(TokenView()).map([](auto) -> size_t { return 1; });
+
+            auto pick = Pick(
+                std::move(object), std::move(array), string(),
+                literal("true"), literal("false"), literal("null"), std::move(number)
+            );
+
+            if (compiled) {
+                value.define(compilable(std::move(pick)));
+                program.emplace(compile(value.wrap()));
+            } else {
+                value.define(std::move(pick));
+            }
+        }
+
+        size_t parse(std::string_view text) const {
+            State state(text);
+            NotSpace space;
+            Context context(state, space, token);
+
+            auto result = program ? program->expose(context) : value.get()->dispatch(context);
+
+            if (!result.ptr() || state.index != state.count)
+                throw std::runtime_error("json benchmark input did not parse");
+
+            return std::get<0>(*result.ptr());
+        }
+    };
+
+    // Evaluates arithmetic statements with wrapping integers, parentheses recurse through Wrap.
+    // Precedence comes either from nested Rule/Many levels or from a single Operators table,
+    // the nested levels can also be compiled into a program.
+    struct ExpressionGrammar {
+        Recursive<uint64_t> expression;
+
+        Rule<Wrap<uint64_t>, Text> statement = Rule(expression.wrap(), Text(";"));
+        std::optional<Program<std::tuple<uint64_t>>> program;
+
+        static uint64_t apply(char op, uint64_t left, uint64_t right) {
+            switch (op) {
+                case '+': return left + right;
+                case '-': return left - right;
+                case '*': return left * right;
+                default: return right ? left / right : 0;
+            }
+        }
+
+        template <typename Operand>
+        static auto chain(Operand operand, const char *first, const char *second) {
+            auto sign = Pick(
+                Rule(Text(first)).map([first](auto) { return first[0]; }),
+                Rule(Text(second)).map([second](auto) { return second[0]; })
+            );
+
+            auto step = Rule(std::move(sign), Operand(operand)).map([](auto tuple) { return tuple; });
+
+            return Rule(std::move(operand), std::move(step).many()).map([](auto tuple) {
+                auto value = std::get<0>(tuple);
+
+                for (auto [op, operand] : std::get<1>(tuple))
+                    value = apply(op, value, operand);
+
+                return value;
+            });
+        }
+
+        ExpressionGrammar(bool table, bool compiled) {
+            auto number = Rule(TokenView()).map([](auto tuple) {
+                auto text = std::get<0>(tuple);
+
+                uint64_t value = 0;
+                std::from_chars(text.data(), text.data() + text.size(), value);
+
+                return value;
+            });
+
+            auto group = Rule(Text("("), expression.wrap(), Text(")"))
+                .map([](auto tuple) { return std::get<0>(tuple); });
+
+            auto factor = Pick(std::move(group), std::move(number));
+
+            if (table) {
+                expression.define(Operators(std::move(factor), { { "+", 1 }, { "-", 1 }, { "*", 2 }, { "/", 2 } },
+                    [](const Operator &op, uint64_t left, uint64_t right) { return apply(op.text[0], left, right); }));
+            } else if (compiled) {
+                expression.define(compilable(chain(chain(std::move(factor), "*", "/"), "+", "-")));
+                program.emplace(compile(statement));
+            } else {
+                expression.define(chain(chain(std::move(factor), "*", "/"), "+", "-"));
+            }
+        }
+
+        uint64_t parse(std::string_view text) const {
+            State state(text);
+            NotSpace space;
+            AnyHard token;
+            Context context(state, space, token);
+
+            uint64_t total = 0;
+
+            auto add = [&total](uint64_t value) { total += value; };
+            auto result = program ? exposeEach(*program, context, add) : exposeEach(statement, context, add);
+
+            if (!result.ptr())
+                throw std::runtime_error("expression benchmark input did not parse");
+
+            return total;
+        }
+    };
+
+    // Counts error lines in a timestamp, level, [module], message log.
+    struct LogGrammar {
+        AnyHard token = AnyHard({ '[', ']' });
+
+        size_t parse(std::string_view text) const {
+            State state(text);
+            NotSpace space;
+            Context context(state, space, token);
+
+            auto line = Rule(TokenView(), TokenView(), Text("["), TokenView(), Text("]"), UntilView({ "\n" }))
+                .map([](auto tuple) -> size_t { return std::get<1>(tuple) == "ERROR"; });
+
+            size_t errors = 0;
+
+            auto result = exposeEach(line, context, [&errors](size_t error) { errors += error; });
+
+            if (!result.ptr())
+                throw std::runtime_error("log benchmark input did not parse");
+
+            return errors;
+        }
+    };
+
+    // Sums field lengths of 16-field records with one long Rule per record, stressing sequence results.
+    struct RecordGrammar {
+        AnyHard token = AnyHard({ ',' });
+
+        size_t parse(std::string_view text) const {
+            State state(text);
+            NotSpace space;
+            Context context(state, space, token);
+
+            auto field = [] { return Rule(TokenView(), Text(",")); };
+
+            auto record = Rule(
+                field(), field(), field(), field(), field(), field(), field(), field(),
+                field(), field(), field(), field(), field(), field(), field(), TokenView()
+            ).map([](auto tuple) {
+                return std::apply([](auto ...fields) { return (fields.size() + ...); }, tuple);
+            });
+
+            size_t total = 0;
+
+            auto result = exposeEach(record, context, [&total](size_t size) { total += size; });
+
+            if (!result.ptr())
+                throw std::runtime_error("records benchmark input did not parse");
+
+            return total;
+        }
+    };
+
+    // Value counting how often it is copied or moved on its way into a sequence's result.
+    struct Counted {
+        static inline size_t transfers = 0;
+
+        Counted() = default;
+        Counted(const Counted &) { transfers++; }
+        Counted(Counted &&) noexcept { transfers++; }
+
+        Counted &operator=(const Counted &) { transfers++; return *this; }
+        Counted &operator=(Counted &&) noexcept { transfers++; return *this; }
+    };
+
+    // Transfers per value when a 16 component Rule builds its result, and the size of results.
+    void sequence() {
+        State state("");
+        NotSpace space;
+        AnyHard token;
+        Context context(state, space, token);
+
+        auto rule = Rule(
+            Counted(), Counted(), Counted(), Counted(), Counted(), Counted(), Counted(), Counted(),
+            Counted(), Counted(), Counted(), Counted(), Counted(), Counted(), Counted(), Counted()
+        );
+
+        Counted::transfers = 0;
+
+        auto result = rule.expose(context);
+
+        if (!result.ptr())
+            throw std::runtime_error("sequence benchmark did not parse");
+
+        std::printf(
+            R"({"benchmark": "sequence", "components": 16, "transfers_per_value": %.2f, )"
+            R"("result_bytes": %zu, "error_bytes": %zu})" "\n",
+            static_cast<double>(Counted::transfers) / 16, sizeof(ParserResult<std::string_view>), sizeof(Error)
+        );
+    }
+
+    size_t peakResident() {
+        rusage usage { };
+        getrusage(RUSAGE_SELF, &usage);
+
+        return static_cast<size_t>(usage.ru_maxrss) * 1024;
+    }
+
+    size_t parseSize(std::string_view text) {
+        size_t value = 0;
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+
+        switch (end == text.data() + text.size() ? '\0' : *end) {
+            case 'K': case 'k': return value << 10;
+            case 'M': case 'm': return value << 20;
+            case 'G': case 'g': return value << 30;
+            default: return value;
+        }
+    }
+
+    std::vector<std::string_view> split(std::string_view text) {
+        std::vector<std::string_view> parts;
+
+        while (!text.empty()) {
+            auto comma = text.find(',');
+            parts.push_back(text.substr(0, comma));
+
+            text = comma == std::string_view::npos ? std::string_view() : text.substr(comma + 1);
+        }
+
+        return parts;
+    }
+
+    void run(std::string_view grammar, const std::string &text, double budget,
+        const std::function<size_t(std::string_view)> &parse) {
+        size_t iterations = 0;
+        size_t checksum = 0;
+
+        size_t allocationsBefore = allocations.load();
+        size_t allocatedBefore = allocated.load();
+
+        auto start = std::chrono::steady_clock::now();
+        double seconds = 0;
+
+        do {
+            checksum = parse(text);
+            iterations++;
+
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (seconds < budget);
+
+        auto megabytes = static_cast<double>(text.size() * iterations) / (1024.0 * 1024.0);
+
+        std::printf(
+            R"({"benchmark": "grammar", "grammar": "%.*s", "bytes": %zu, "iterations": %zu, "seconds": %.6f, )"
+            R"("mbps": %.2f, "allocations": %zu, "allocated_bytes": %zu, "peak_rss_bytes": %zu, "checksum": %zu})" "\n",
+            static_cast<int>(grammar.size()), grammar.data(), text.size(), iterations, seconds, megabytes / seconds,
+            (allocations.load() - allocationsBefore) / iterations, (allocated.load() - allocatedBefore) / iterations,
+            peakResident(), checksum
+        );
+
+        std::fflush(stdout);
+    }
+}
+
+int main(int argc, char **argv) {
+    auto sizes = split(argc > 1 ? argv[1] : "1K,64K,1M,16M");
+    auto grammars = split(argc > 2 ? argv[2] : "json,json-vm,expression,expression-vm,operators,log,records");
+    double budget = argc > 3 ? std::strtod(argv[3], nullptr) : 0.5;
+
+    sequence();
+
+    JsonGrammar json(false);
+    JsonGrammar jsonProgram(true);
+    ExpressionGrammar expression(false, false);
+    ExpressionGrammar expressionProgram(false, true);
+    ExpressionGrammar operators(true, false);
+    LogGrammar log;
+    RecordGrammar records;
+
+    for (auto grammar : grammars) {
+        for (auto size : sizes) {
+            auto bytes = parseSize(size);
+
+            if (grammar == "json") {
+                run(grammar, generateJson(bytes), budget, [&json](auto text) { return json.parse(text); });
+            } else if (grammar == "json-vm") {
+                run(grammar, generateJson(bytes), budget, [&jsonProgram](auto text) { return jsonProgram.parse(text); });
+            } else if (grammar == "expression") {
+                run(grammar, generateExpressions(bytes), budget, [&expression](auto text) {
+                    return static_cast<size_t>(expression.parse(text));
+                });
+            } else if (grammar == "expression-vm") {
+                run(grammar, generateExpressions(bytes), budget, [&expressionProgram](auto text) {
+                    return static_cast<size_t>(expressionProgram.parse(text));
+                });
+            } else if (grammar == "operators") {
+                run(grammar, generateExpressions(bytes), budget, [&operators](auto text) {
+                    return static_cast<size_t>(operators.parse(text));
+                });
+            } else if (grammar == "log") {
+                run(grammar, generateLog(bytes), budget, [&log](auto text) { return log.parse(text); });
+            } else if (grammar == "records") {
+                run(grammar, generateRecords(bytes), budget, [&records](auto text) { return records.parse(text); });
+            } else {
+                std::fprintf(stderr, "unknown grammar %.*s\n", static_cast<int>(grammar.size()), grammar.data());
+
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
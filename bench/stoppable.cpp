@@ -0,0 +1,133 @@
+#include <crimson/crimson.h>
+
+#include <chrono>
+#include <random>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+
+// Compares per-byte virtual dispatch, CRTP static dispatch and the vectorized ByteClass on the same predicate.
+// Prints one JSON object per case.
+
+namespace {
+    struct VirtualNotSpace: public Stoppable {
+        [[nodiscard]]
+        bool stop(std::string_view view, State &) const override {
+            return !std::isspace(static_cast<uint8_t>(view[0]));
+        }
+    };
+
+    struct StaticNotSpace final: public StaticStoppable<StaticNotSpace> {
+        [[nodiscard]]
+        bool test(std::string_view view, State &) const {
+            return !std::isspace(static_cast<uint8_t>(view[0]));
+        }
+    };
+
+    struct VirtualSpace: public Stoppable {
+        [[nodiscard]]
+        bool stop(std::string_view view, State &) const override {
+            return std::isspace(static_cast<uint8_t>(view[0]));
+        }
+    };
+
+    struct StaticSpace final: public StaticStoppable<StaticSpace> {
+        [[nodiscard]]
+        bool test(std::string_view view, State &) const {
+            return std::isspace(static_cast<uint8_t>(view[0]));
+        }
+    };
+
+    std::array<bool, 256> inverse(std::array<bool, 256> table) {
+        for (auto &value : table)
+            value = !value;
+
+        return table;
+    }
+
+    // Alternating runs of spaces and letters with the given average run length.
+    std::string generate(size_t size, size_t run) {
+        std::mt19937 random(42); // NOLINT(cert-msc51-cpp)
+        std::uniform_int_distribution<size_t> length(1, run * 2);
+
+        std::string text;
+        text.reserve(size);
+
+        bool space = false;
+
+        while (text.size() < size) {
+            auto count = std::min(length(random), size - text.size());
+
+            for (size_t a = 0; a < count; a++) {
+                text.push_back(space ? " \t\n"[a % 3] : static_cast<char>('a' + (a % 26)));
+            }
+
+            space = !space;
+        }
+
+        return text;
+    }
+
+    // Alternates skipping spaces and scanning tokens like Push and Token do.
+    template <typename SpaceType, typename TokenType>
+    size_t scan(const std::string &text, const SpaceType &space, const TokenType &token) {
+        State state(text);
+
+        size_t tokens = 0;
+
+        while (state.index < state.count) {
+            state.push(space);
+
+            auto size = state.until(token);
+            state.index += size;
+
+            tokens += size > 0;
+        }
+
+        return tokens;
+    }
+
+    template <typename SpaceType, typename TokenType>
+    void run(const char *name, const std::string &text, size_t runLength, size_t iterations,
+        const SpaceType &space, const TokenType &token) {
+        size_t tokens = 0;
+
+        auto start = std::chrono::steady_clock::now();
+
+        for (size_t a = 0; a < iterations; a++) {
+            tokens += scan(text, space, token);
+        }
+
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        auto megabytes = static_cast<double>(text.size() * iterations) / (1024.0 * 1024.0);
+
+        std::printf(
+            R"({"benchmark": "stoppable", "case": "%s", "run": %zu, "bytes": %zu, "tokens": %zu, "seconds": %.6f, "mbps": %.2f})" "\n",
+            name, runLength, text.size(), tokens / iterations, seconds, megabytes / seconds
+        );
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t size = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 16 * 1024 * 1024;
+    size_t iterations = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 4;
+
+    for (size_t runLength : { 4, 16, 64 }) {
+        auto text = generate(size, runLength);
+
+        // Mixing in a Stoppable reference forces the virtual overloads.
+        VirtualNotSpace virtualNotSpace;
+        VirtualSpace virtualSpace;
+        run("virtual", text, runLength, iterations,
+            static_cast<const Stoppable &>(virtualNotSpace), static_cast<const Stoppable &>(virtualSpace));
+
+        run("static", text, runLength, iterations, StaticNotSpace { }, StaticSpace { });
+
+        NotSpace notSpace;
+        ByteClass space(inverse(notSpace.table));
+        run("byte-class", text, runLength, iterations,
+            static_cast<const Stoppable &>(notSpace), static_cast<const Stoppable &>(space));
+    }
+
+    return 0;
+}
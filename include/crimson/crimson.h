@@ -1,27 +1,50 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <tuple>
+#include <bitset>
+#include <memory>
+#include <limits>
 #include <vector>
 #include <string>
+#include <cassert>
+#include <cstdint>
+#include <deque>
+#include <concepts>
 #include <sstream>
+#include <variant>
 #include <optional>
+#include <shared_mutex>
+#include <memory_resource>
+#include <utility>
+#include <algorithm>
 #include <string_view>
+#include <unordered_map>
 #include <unordered_set>
 
 struct Context;
 
+// Rules are immutable once built: expose is const and everything a parse changes lives in its State and Context.
+// A grammar, including AnyRule/Wrap graphs and stoppables, can be shared by any number of threads parsing at once
+// as long as each parse has its own State (and MemoTable, arena and diagnostics, if any). Rules must outlive
+// every parse and Program using them. The few counters kept in rules (SepBy's reserve average, profiles) are atomic.
 template <typename T>
 concept Exposable = requires(T t, Context &context) {
     t.expose(context);
 };
 
-struct ErrorMustMatchText { std::string text; };
-struct ErrorRequiresSpaceAfter { std::string keyword; };
+// Literals are views into the failing rule, errors must not outlive the grammar.
+struct ErrorMustMatchText { std::string_view text; };
+struct ErrorRequiresSpaceAfter { std::string_view keyword; };
+struct ErrorExpectedOneOf { std::shared_ptr<const std::vector<std::string_view>> texts; };
 struct ErrorMissingToken { };
 struct ErrorProhibitsPattern { };
 struct ErrorNoMatchingPattern { };
 struct ErrorMustEnd { };
 struct ErrorVerifyFailure { std::string reason; };
+struct ErrorExpectedNumber { };
+struct ErrorNumberOutOfRange { std::string text; };
 
 using ErrorReason = std::variant<
     ErrorMustMatchText,
@@ -30,7 +53,10 @@ using ErrorReason = std::variant<
     ErrorProhibitsPattern,
     ErrorNoMatchingPattern,
     ErrorMustEnd,
-    ErrorVerifyFailure
+    ErrorVerifyFailure,
+    ErrorExpectedOneOf,
+    ErrorExpectedNumber,
+    ErrorNumberOutOfRange
 >;
 
 std::string reasonText(const ErrorReason &reason);
@@ -43,72 +69,144 @@ struct Error {
 
     Error &operator=(Error &&error) = default;
 
+    [[nodiscard]]
+    Error clone() const;
+
     Error(size_t index, ErrorReason reason, bool matched);
 
     Error(const Error &other) = delete;
     Error(Error &&error) noexcept = default;
 };
 
+struct LinePosition {
+    size_t line = 0; // starting at 1
+    size_t column = 0;
+
+    // Line span without its newline.
+    size_t start = 0;
+    size_t end = 0;
+};
+
+// Offsets of every line start, built once per input so each lookup is a binary search.
+struct LineIndex {
+    size_t size = 0;
+    std::vector<size_t> starts;
+
+    [[nodiscard]]
+    LinePosition locate(size_t index) const;
+
+    explicit LineIndex(std::string_view text);
+};
+
 struct LineDetails {
     std::string line;
     std::string marker;
 
     size_t lineNumber = 0;
 
+    LineDetails(std::string_view text, const LineIndex &lines, size_t index, bool backtrack = true);
     LineDetails(const std::string &text, size_t index, bool backtrack = true);
 };
 
+// Either a value or an error, tagged by a flag so ptr() and error() are a single test instead of a visit.
+// The error is kept out of line so a result is its value and a flag, rules reuse the Errors they drop through
+// State::recycle. Not a std::variant, so std::visit, std::get and std::holds_alternative don't apply, use ptr() and error().
 template <typename T, typename ErrorT = Error>
-struct Result : public std::variant<T, ErrorT> {
+struct Result {
     using Type = T;
 
+    bool ok;
+
+    union {
+        T value;
+        std::unique_ptr<ErrorT> failure;
+    };
+
     [[nodiscard]]
     const T *ptr() const {
-        struct {
-            const T *operator()(const T &t) { return &t; }
-            const T *operator()(const ErrorT &) { return nullptr; }
-        } visitor { };
-
-        return std::visit(visitor, *this);
+        return ok ? &value : nullptr;
     }
 
     [[nodiscard]]
     T *ptr() {
-        struct {
-            T *operator()(T &t) { return &t; }
-            T *operator()(ErrorT &) { return nullptr; }
-        } visitor { };
-
-        return std::visit(visitor, *this);
+        return ok ? &value : nullptr;
     }
 
     [[nodiscard]]
     const ErrorT *error() const {
-        struct {
-            const ErrorT *operator()(const T &) { return nullptr; }
-            const ErrorT *operator()(const ErrorT &e) { return &e; }
-        } visitor { };
-
-        return std::visit(visitor, *this);
+        return ok ? nullptr : failure.get();
     }
 
     [[nodiscard]]
     ErrorT *error() {
-        struct {
-            ErrorT *operator()(T &) { return nullptr; }
-            ErrorT *operator()(ErrorT &e) { return &e; }
-        } visitor { };
+        return ok ? nullptr : failure.get();
+    }
 
-        return std::visit(visitor, *this);
+    // Hands the error of a failed result over without copying it, to fail a result of another type with.
+    // The result is left with neither a value nor an error.
+    [[nodiscard]]
+    std::unique_ptr<ErrorT> release() {
+        assert(!ok);
+
+        return std::move(failure);
     }
 
-    Result<T, ErrorT> &operator=(Result<T, ErrorT> &&other) noexcept = default;
+    Result<T, ErrorT> &operator=(Result<T, ErrorT> &&other)
+        noexcept(std::is_nothrow_move_constructible_v<T> && std::is_nothrow_move_assignable_v<T>) {
+        if (this == &other)
+            return *this;
+
+        if (ok && other.ok) {
+            value = std::move(other.value);
+        } else if (!ok && !other.ok) {
+            failure = std::move(other.failure);
+        } else if (ok) {
+            value.~T();
+            new (&failure) std::unique_ptr<ErrorT>(std::move(other.failure));
+            ok = false;
+        } else {
+            // Keep the error until the value is in place, a throwing move leaves this result as it was.
+            auto previous = std::move(failure);
+            failure.~unique_ptr();
+
+            if constexpr (std::is_nothrow_move_constructible_v<T>) {
+                new (&value) T(std::move(other.value));
+            } else {
+                try {
+                    new (&value) T(std::move(other.value));
+                } catch (...) {
+                    new (&failure) std::unique_ptr<ErrorT>(std::move(previous));
+                    throw;
+                }
+            }
+
+            ok = true;
+        }
+
+        return *this;
+    }
 
     Result(const Result<T, ErrorT> &other) = delete;
-    Result(Result<T, ErrorT> &&other) noexcept = default;
 
-    explicit Result(T &&t) : std::variant<T, ErrorT>(std::forward<T>(t)) { }
-    explicit Result(ErrorT &&e) : std::variant<T, ErrorT>(std::move(e)) { }
+    Result(Result<T, ErrorT> &&other) noexcept(std::is_nothrow_move_constructible_v<T>) : ok(other.ok) {
+        if (ok)
+            new (&value) T(std::move(other.value));
+        else
+            new (&failure) std::unique_ptr<ErrorT>(std::move(other.failure));
+    }
+
+    explicit Result(T &&t) : ok(true), value(std::forward<T>(t)) { }
+    explicit Result(std::unique_ptr<ErrorT> &&e) : ok(false), failure(std::move(e)) { }
+
+    // Allocates, rules pass errors on with release() instead.
+    explicit Result(ErrorT &&e) : ok(false), failure(std::make_unique<ErrorT>(std::move(e))) { }
+
+    ~Result() {
+        if (ok)
+            value.~T();
+        else
+            failure.~unique_ptr();
+    }
 };
 
 template <typename ...Args>
@@ -117,51 +215,471 @@ struct ParserResult: public Result<std::tuple<Args...>> {
     using ExtendType = ParserResult<Args..., OtherArgs...>;
 
     explicit ParserResult(std::tuple<Args...> &&t) : Result<std::tuple<Args...>>(std::forward<std::tuple<Args...>>(t)) { }
+    explicit ParserResult(std::unique_ptr<Error> &&e) : Result<std::tuple<Args...>>(std::move(e)) { }
     explicit ParserResult(Error &&e) : Result<std::tuple<Args...>>(std::move(e)) { }
 };
 
 struct State;
 
+// Bytes a rule can start matching on, used to skip alternatives that would fail on their first byte.
+// Nullable rules can also succeed without consuming input, unknown rules are never skipped.
+struct FirstSet {
+    std::bitset<256> bytes;
+
+    bool nullable = false;
+    bool known = true;
+
+    // The literal the rule must start with, if there is exactly one. Reported when the rule is skipped.
+    std::string_view literal;
+
+    [[nodiscard]]
+    bool accepts(uint8_t byte) const;
+
+    // Union, for alternatives.
+    FirstSet &operator|=(const FirstSet &other);
+
+    // First set of this rule followed by next.
+    [[nodiscard]]
+    FirstSet then(const FirstSet &next) const;
+
+    static FirstSet unknown();
+    static FirstSet empty();
+    static FirstSet of(std::string_view text);
+};
+
 struct Stoppable {
     [[nodiscard]]
     virtual bool stop(std::string_view view, State &state) const = 0;
+
+    // Number of bytes at the start of view before stop would return true, view is never empty.
+    [[nodiscard]]
+    virtual size_t span(std::string_view view, State &state) const;
+
+    // How many bytes stop needs to see to decide, chunked inputs load at least this much before asking.
+    [[nodiscard]]
+    virtual size_t reach() const;
 };
 
-struct AnyHard: public Stoppable {
-    std::unordered_set<char> stopAt;
+// Stoppable with a predicate known at compile time. Self implements a non-virtual test(view, state),
+// span() calls it directly so the predicate inlines into the scanning loop, stop() forwards to it for dynamic use.
+template <typename Self>
+struct StaticStoppable: public Stoppable {
+    [[nodiscard]]
+    bool stop(std::string_view view, State &state) const final {
+        return static_cast<const Self &>(*this).test(view, state);
+    }
 
     [[nodiscard]]
-    bool stop(std::string_view view, State &state) const override;
+    size_t span(std::string_view view, State &state) const override {
+        auto &self = static_cast<const Self &>(*this);
 
-    AnyHard();
-    explicit AnyHard(std::unordered_set<char> stopAt);
+        size_t size = 0;
+
+        while (size < view.size() && !self.test(view.substr(size), state)) {
+            size++;
+        }
+
+        return size;
+    }
 };
 
-struct NotSpace: public Stoppable {
+// Stoppables whose dynamic type is known at the call site, State can call their members without the vtable.
+template <typename T>
+concept ConcreteStoppable = std::derived_from<T, Stoppable> && std::is_final_v<T>;
+
+// Stops on any byte in a 256-entry table, scanning 16 or 32 bytes at a time where the CPU allows.
+struct ByteClass: public Stoppable {
+    std::array<bool, 256> table { };
+
+    // Nibble lookup tables, a byte is in the class when low[byte & 0xF] & high[byte >> 4] is non-zero.
+    // Only usable when the table has at most 8 distinct rows of 16 bytes.
+    bool vectorized = false;
+    std::array<uint8_t, 16> low { };
+    std::array<uint8_t, 16> high { };
+
     [[nodiscard]]
     bool stop(std::string_view view, State &state) const override;
+
+    [[nodiscard]]
+    size_t span(std::string_view view, State &state) const override;
+
+    explicit ByteClass(const std::array<bool, 256> &table);
 };
 
+struct AnyHard: public ByteClass {
+    AnyHard();
+    explicit AnyHard(const std::unordered_set<char> &stopAt);
+};
+
+struct NotSpace: public ByteClass {
+    NotSpace();
+};
+
+// Stops before any of a set of strings. Compiled once: spans skip to bytes that can start a stop with ByteClass,
+// then only compare the stops sharing that first byte.
 struct StringStops: public Stoppable {
-    const std::vector<std::string_view> &stops;
+    ByteClass first;
+
+    // Non-empty stops sorted by first byte, stops starting with byte b are in [offsets[b], offsets[b + 1]).
+    std::vector<std::string_view> stops;
+    std::array<uint32_t, 257> offsets { };
+
+    bool stopsEmpty = false;
 
     [[nodiscard]]
     bool stop(std::string_view view, State &state) const override;
 
+    [[nodiscard]]
+    size_t span(std::string_view view, State &state) const override;
+
+    [[nodiscard]]
+    size_t reach() const override;
+
     explicit StringStops(const std::vector<std::string_view> &stops);
 };
 
+// Trie over a set of literals, finds every literal the input starts with in one pass.
+struct LiteralTrie {
+    struct Node {
+        uint32_t edges = 0; // first outgoing edge, edges are sorted by byte
+        uint32_t count = 0;
+        uint32_t depth = 0;
+
+        int32_t value = -1; // index of the literal ending here
+        int32_t shorter = -1; // closest ancestor ending a literal
+    };
+
+    struct Edge {
+        uint8_t byte;
+        uint32_t node;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Edge> edges;
+
+    size_t longest = 0;
+
+    // Deepest node ending a literal that view starts with, -1 if there is none. Node::shorter leads to the others.
+    [[nodiscard]]
+    int32_t deepest(std::string_view view) const;
+
+    // Duplicates and empty literals are ignored, the first occurrence of a literal keeps its index.
+    explicit LiteralTrie(const std::vector<std::string> &literals);
+};
+
+// Packrat cache for Memo rules. Entries are keyed by rule identity, input index and the calling context.
+// The table only makes sense for one input at a time, call clear() before reusing it on another parse,
+// or edit() when the new input is an edited copy of the old one. Results holding views (see HoldsViews) are
+// not reused after an edit, the edited input is another buffer. Results holding Anchors are reused only where
+// the edit did not move them.
+struct MemoTable {
+    struct Key {
+        const void *rule;
+        size_t index;
+
+        const Stoppable *space;
+        const Stoppable *token;
+
+        bool matched;
+
+        bool operator==(const Key &other) const = default;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key &key) const;
+    };
+
+    // Positions are relative to the index in the key, so they stay right wherever an edit moves the entry.
+    struct Entry {
+        size_t end;
+        size_t reach;
+        bool matched;
+
+        // Offset of a cached error, 0 for results. The index in the cached Error is not kept up to date.
+        size_t failure;
+
+        std::unique_ptr<void, void(*)(void *)> value;
+
+        // Offset of the furthest State::commit the rule made, npos if it made none. Replayed on hits.
+        size_t cut = std::string_view::npos;
+
+        bool anchored = false;
+        bool views = false;
+
+        // Filled by insert: how far the entry had moved, how many edits were made when it was cached and whether
+        // what it looked at was one segment. Entries spanning several are only right until the next edit.
+        size_t shift = 0;
+        size_t edits = 0;
+        bool contained = true;
+    };
+
+    // A run of the current input at [start, end) that was at [stored, ...) when the entries in it were keyed.
+    struct Segment {
+        size_t start;
+        size_t end;
+        size_t stored;
+    };
+
+    size_t capacity;
+    std::unordered_map<Key, Entry, KeyHash> entries;
+
+    // Empty until the first edit, keys are current indexes then. Otherwise covers every index in order.
+    std::vector<Segment> segments;
+
+    // Stored positions for inserted bytes start here, far past any input.
+    constexpr static size_t freshStart = size_t(1) << 62;
+    size_t fresh = freshStart;
+
+    size_t edits = 0;
+
+    // Edits are cheap while segments are few, past this many the entries are rekeyed and the segments dropped.
+    constexpr static size_t maxSegments = 256;
+
+    // Looks key up at a current index, nullptr if there is no entry, it is before floor or the edits since made it stale.
+    [[nodiscard]]
+    const Entry *find(const Key &key) const;
+
+    void insert(const Key &key, Entry entry);
+
+    void clear();
+
+    // Entries before floor are never looked up again, they are swept once the table has doubled since the last sweep.
+    size_t floor = 0;
+    size_t sweep = 1024;
+
+    void discard(size_t before);
+
+    // Carries the table over to the input after bytes [start, start + removed) were replaced by inserted new bytes.
+    // Only the segments are split, entries that looked at the replaced bytes go stale and entries after them
+    // are found at their new indexes, so parsing the edited input again only recomputes rules around the edit.
+    void edit(size_t start, size_t removed, size_t inserted);
+
+    // Rekeys the entries still valid by current index and forgets the segments.
+    void compact();
+
+    // The segment holding a current index.
+    [[nodiscard]]
+    const Segment &segment(size_t index) const;
+
+    // Whether an entry found at index in run can still be used.
+    [[nodiscard]]
+    bool valid(const Entry &entry, const Segment &run, size_t index) const;
+
+    explicit MemoTable(size_t capacity = 1 << 20);
+};
+
+using Symbol = uint32_t;
+
+// Interned strings numbered densely in first-seen order. Each distinct text is stored once and never moves,
+// so resolved views stay valid as long as the table, and interning a known text does not allocate.
+struct SymbolTable {
+    std::deque<std::string> texts;
+    std::unordered_map<std::string_view, Symbol> ids;
+
+    [[nodiscard]]
+    virtual Symbol intern(std::string_view text);
+
+    [[nodiscard]]
+    virtual std::string_view resolve(Symbol symbol) const;
+
+    [[nodiscard]]
+    virtual size_t size() const;
+
+    SymbolTable() = default;
+    SymbolTable(const SymbolTable &other) = delete;
+
+    virtual ~SymbolTable() = default;
+};
+
+// SymbolTable for parses on several threads at once, known texts are found under a shared lock.
+struct SharedSymbolTable: public SymbolTable {
+    mutable std::shared_mutex mutex;
+
+    [[nodiscard]]
+    Symbol intern(std::string_view text) override;
+
+    [[nodiscard]]
+    std::string_view resolve(Symbol symbol) const override;
+
+    [[nodiscard]]
+    size_t size() const override;
+};
+
+// Totals for Profile rules registered under one name. Every counter is updated with relaxed atomics,
+// so rules shared between threads add up without locking.
+struct ProfileCounters {
+    std::string name;
+
+    std::atomic<uint64_t> calls = 0;
+    std::atomic<uint64_t> successes = 0;
+    std::atomic<uint64_t> failures = 0;
+
+    std::atomic<uint64_t> consumed = 0; // bytes matched by successful calls
+    std::atomic<uint64_t> backtracked = 0; // bytes failed calls had advanced over before failing
+
+    std::atomic<uint64_t> nanoseconds = 0; // including nested rules
+
+    // Counters for name, registered on first use and kept for the rest of the program.
+    [[nodiscard]]
+    static ProfileCounters &get(std::string_view name);
+
+    // Table of every registered name, slowest first.
+    static void report(std::ostream &out);
+
+    static void reset();
+
+    explicit ProfileCounters(std::string name);
+};
+
+struct ChunkedInput;
+struct ProgramStacks;
+
 struct State {
+    // Loaded input, text[0] is the byte at index base. Contiguous inputs have base 0 and everything loaded,
+    // chunked inputs load more on demand and may drop bytes before a released index.
     const char *text;
     size_t index;
     size_t count;
 
+    size_t base = 0;
+
+    ChunkedInput *input = nullptr;
+    size_t released = 0;
+
+    MemoTable *memo = nullptr;
+
+    // Used by InternToken rules that were not given a table of their own.
+    SymbolTable *symbols = nullptr;
+
+    // Arena rules (ArenaMany, ArenaToken, ArenaCapture, MakeArena) allocate from here. Point it at a
+    // std::pmr::monotonic_buffer_resource per parse to release the whole tree at once, results must not outlive it.
+    std::pmr::memory_resource *resource = std::pmr::get_default_resource();
+
+    // Furthest index any rule failed at, the first reason given there and the literals every rule expected there.
+    // fail() only appends views, failure() deduplicates them, so recording does not allocate once the vector has grown.
+    size_t furthest = 0;
+    std::optional<ErrorReason> reason;
+    std::vector<std::string_view> expected;
+
+    constexpr static size_t maxExpected = 64;
+
+    void fail(size_t at, const ErrorReason &reason);
+
+    // Errors of failed results that rules dropped while backtracking, reused by the next failures so a parse
+    // stops allocating for them once it has a few.
+    std::vector<std::unique_ptr<Error>> spare;
+
+    constexpr static size_t maxSpare = 16;
+
+    // An Error for a failed result, from spare when there is one.
+    [[nodiscard]]
+    std::unique_ptr<Error> raise(size_t at, ErrorReason reason, bool matched);
+
+    // Keeps the error of a result that is being dropped for raise to reuse.
+    void recycle(std::unique_ptr<Error> error) {
+        if (error && spare.size() < maxSpare)
+            spare.push_back(std::move(error));
+    }
+
+    // Built on first use, shared between copies of the state. Covers only the loaded window for chunked inputs,
+    // which rebuild it once the window starting at lineBase has moved or grown.
+    std::shared_ptr<const LineIndex> lineIndex;
+    size_t lineBase = 0;
+
+    [[nodiscard]]
+    const LineIndex &lines();
+
+    // A single error describing everything expected at the furthest failure, for when the whole parse fails.
+    [[nodiscard]]
+    Error failure() const;
+
+    // Puts failure() in place of the error a whole parse ended with, unless no rule recorded a failure that far.
+    void report(Error &error) const;
+
+    [[nodiscard]]
+    const char *data(size_t at) const {
+        return text + (at - base);
+    }
+
+    // One past the furthest byte any primitive looked at, past count once a rule saw the end of the input.
+    // Memo entries keep it so an edit knows which results depended on the changed bytes.
+    size_t examined = 0;
+
+    // Counts Anchors run, Memo entries whose rule ran one hold indexes that an edit moving them would make wrong.
+    size_t anchors = 0;
+
+    // Loads input until bytes up to end are available, false if the input ends first.
+    bool ensure(size_t end) {
+        examined = std::max(examined, end);
+
+        return end <= count || (input && fill(end));
+    }
+
+    bool fill(size_t end);
+
+    // Promises no rule will go back before at, letting chunked inputs drop everything in front of it.
+    void release(size_t at);
+
+    // Where Recover rules record the errors they skip over, recovery is off while this is null.
+    std::vector<Error> *diagnostics = nullptr;
+
+    // Diagnostics recorded so far. Rules that backtrack forget the ones recorded since, parsing the input
+    // again records them again if they still apply.
+    [[nodiscard]]
+    size_t recorded() const {
+        return diagnostics ? diagnostics->size() : 0;
+    }
+
+    void forget(size_t recorded) {
+        if (diagnostics && diagnostics->size() > recorded)
+            diagnostics->erase(diagnostics->begin() + static_cast<std::ptrdiff_t>(recorded), diagnostics->end());
+    }
+
+    // Stacks of compiled programs (program.h), kept for the whole parse so a program run per item doesn't allocate.
+    std::shared_ptr<ProgramStacks> stacks;
+
+    // Set by Cut, alternatives and repetitions that started before it fail rather than backtrack.
+    size_t committed = 0;
+
+    // Releases everything before at and makes backtracking over it an error, memo entries before it are dropped.
+    void commit(size_t at);
+
+    // Bytes from start before span stops, loading more input when the scan runs into the end of the buffer.
+    // Stops see up to reach bytes, so a result that close to the end is retried once more input is loaded.
+    template <typename Span>
+    size_t scan(size_t start, size_t reach, Span &&span) {
+        if (!ensure(start + reach) && start >= count)
+            return 0;
+
+        size_t size = 0;
+
+        while (true) {
+            if (start + size < count)
+                size += span(std::string_view(data(start + size), count - start - size));
+
+            examined = std::max(examined, start + size + reach);
+
+            bool stopped = start + size < count && start + size + reach - 1 <= count;
+
+            if (stopped || !input)
+                return size;
+
+            size_t end = count;
+
+            if (!ensure(end + 1))
+                return size;
+
+            size_t retry = end - start >= reach - 1 ? end - start - (reach - 1) : 0;
+            size = std::min(size, retry);
+        }
+    }
+
     void push(const Stoppable &stoppable);
 
     void pop(size_t size, const Stoppable &stoppable);
 
     [[nodiscard]]
-    std::string_view pull(size_t size) const;
+    std::string_view pull(size_t size);
 
     [[nodiscard]]
     size_t until(const Stoppable &stoppable);
@@ -169,7 +687,39 @@ struct State {
     [[nodiscard]]
     bool ends(size_t size, const Stoppable &stoppable);
 
+    template <ConcreteStoppable StoppableType>
+    void push(const StoppableType &stoppable) {
+        index += until(stoppable);
+    }
+
+    template <ConcreteStoppable StoppableType>
+    void pop(size_t size, const StoppableType &stoppable) {
+        index += size;
+
+        push(stoppable);
+    }
+
+    template <ConcreteStoppable StoppableType>
+    [[nodiscard]]
+    size_t until(const StoppableType &stoppable) {
+        return scan(index, stoppable.StoppableType::reach(), [this, &stoppable](std::string_view view) {
+            return stoppable.StoppableType::span(view, *this);
+        });
+    }
+
+    template <ConcreteStoppable StoppableType>
+    [[nodiscard]]
+    bool ends(size_t size, const StoppableType &stoppable) {
+        ensure(index + size + stoppable.StoppableType::reach());
+
+        return (index + size >= count) || stoppable.StoppableType::stop({ data(index + size), count - index - size }, *this);
+    }
+
+    // Starts over on a new contiguous input, keeping memo, resource, diagnostics and the storage of expected.
+    void reset(std::string_view view);
+
     explicit State(std::string_view view);
+    explicit State(ChunkedInput &input);
 };
 
 struct Context {
@@ -191,13 +741,22 @@ struct Context {
     [[nodiscard]]
     bool ends(size_t size);
 
+    [[nodiscard]]
+    std::pmr::memory_resource *resource() const;
+
+    // Only what failed here. A failed parse ends with the last error raised, report State::failure() to users
+    // instead (State::report), as parseParallel, BatchParser and StreamParser do.
     [[nodiscard]]
     Error rawError(ErrorReason reason) const;
 
+    // rawError in an Error of its own, for a failed result.
+    [[nodiscard]]
+    std::unique_ptr<Error> ownedError(ErrorReason reason) const;
+
     template <typename ...Args>
     [[nodiscard]]
     ParserResult<Args...> error(ErrorReason reason) const {
-        return ParserResult<Args...> { rawError(std::move(reason)) };
+        return ParserResult<Args...> { ownedError(std::move(reason)) };
     }
 
     Context(State &state, const Stoppable &space, const Stoppable &token);
@@ -238,12 +797,18 @@ struct IsNoAutoContextHelper<NoAutoContext<T>> {
 template <typename T>
 concept IsNoAutoContext = IsNoAutoContextHelper<T>::value;
 
+struct ProgramBuilder;
+
 template <typename ...Produces>
 struct AnyRule {
     std::unique_ptr<void, void(*)(void *)> value;
 
     ParserResult<Produces...> (* func)(Context &context, void *ptr) = nullptr;
 
+    // Set for rules wrapped by compilable() from program.h, compile() lowers Wraps of other AnyRules to native calls.
+    void (* lower)(const void *rule, ProgramBuilder &builder) = nullptr;
+    bool autoContext = true;
+
     ParserResult<Produces...> dispatch(Context &context) const {
         return func(context, value.get());
     }
@@ -258,6 +823,9 @@ struct AnyRule {
 
             return static_cast<T *>(ptr)->expose(sub);
         };
+
+        if constexpr (requires { T::lowering; })
+            lower = T::lowering;
     }
 
     template <typename T>
@@ -265,6 +833,11 @@ struct AnyRule {
         func = [](Context &context, void *ptr) {
             return static_cast<T *>(ptr)->expose(context);
         };
+
+        if constexpr (requires { T::lowering; })
+            lower = T::lowering;
+
+        autoContext = false;
     }
 #pragma clang diagnostic pop
 
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <crimson/crimson.h>
+
+// Read-only memory map of a whole file, parse it with State(file.view()).
+// Pages are requested sequentially ahead of the parser with madvise.
+struct MappedFile {
+    const char *address = nullptr;
+    size_t size = 0;
+
+    [[nodiscard]]
+    std::string_view view() const;
+
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &other) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+
+    MappedFile &operator=(const MappedFile &other) = delete;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+};
+
+struct Source {
+    // Writes up to size bytes to data and returns how many were written, 0 once the input is over.
+    [[nodiscard]]
+    virtual size_t read(char *data, size_t size) = 0;
+
+    virtual ~Source() = default;
+};
+
+struct FileSource: public Source {
+    int descriptor = -1;
+    bool owned = false;
+
+    [[nodiscard]]
+    size_t read(char *data, size_t size) override;
+
+    explicit FileSource(const std::string &path);
+    explicit FileSource(int descriptor, bool owned = false);
+    ~FileSource() override;
+
+    FileSource(const FileSource &other) = delete;
+};
+
+// Buffers a Source for State(ChunkedInput &), reading chunk bytes at a time.
+// Bytes before State::released are dropped to make room, keeping at most limit bytes buffered, counting
+// replaced buffers that are still alive for views into them.
+// Growing past limit throws std::length_error, release at points the grammar will never backtrack over.
+// Loaded bytes never move while they are still unreleased, so views into them stay valid until released.
+struct ChunkedInput {
+    Source &source;
+
+    size_t chunk;
+    size_t limit;
+
+    std::vector<char> buffer;
+    size_t loaded = 0; // bytes of buffer in use
+
+    // Buffers replaced while views may still point into them, freed once the state releases past end.
+    struct Retired {
+        std::vector<char> buffer;
+        size_t end;
+    };
+
+    std::vector<Retired> retired;
+    size_t retiredSize = 0;
+
+    bool exhausted = false;
+
+    // Loads input into state until end is available, false if the source ends first.
+    bool fill(State &state, size_t end);
+
+    explicit ChunkedInput(Source &source, size_t chunk = 1 << 16, size_t limit = 1 << 30);
+};
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <crimson/tools.h>
+
+#include <span>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
+// Boundaries for splitting text into about pieces parts, each cut right after an occurrence of delimiter.
+// Returns offsets starting with 0 and ending with text.size(), fewer parts if delimiters are sparse.
+[[nodiscard]]
+std::vector<size_t> splitAfter(std::string_view text, std::string_view delimiter, size_t pieces);
+
+// Runs task(0) through task(count - 1) on up to threads threads, returning once all are done.
+// The first exception a task throws is rethrown after the others stop picking up new work.
+void parallelFor(size_t count, size_t threads, const std::function<void(size_t)> &task);
+
+// Threads started once and reused for every run. The calling thread takes part as worker 0.
+// One run at a time, the first exception a task throws is rethrown once the run is over.
+struct WorkerPool {
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    std::vector<std::thread> threads;
+
+    const std::function<void(size_t, size_t)> *task = nullptr;
+    size_t count = 0;
+    std::atomic<size_t> next = 0;
+
+    size_t generation = 0;
+    size_t busy = 0;
+    bool stopping = false;
+
+    std::exception_ptr exception;
+
+    // Threads including the caller.
+    [[nodiscard]]
+    size_t size() const;
+
+    // Runs task(worker, index) for every index below count, worker is below size().
+    void run(size_t total, const std::function<void(size_t worker, size_t index)> &function);
+
+    void work(size_t worker);
+
+    explicit WorkerPool(size_t workers = std::thread::hardware_concurrency());
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &other) = delete;
+};
+
+// Totals over every batch a BatchParser ran.
+struct BatchStats {
+    size_t documents = 0;
+    size_t bytes = 0;
+    size_t failures = 0;
+
+    double seconds = 0;
+
+    [[nodiscard]]
+    double documentsPerSecond() const;
+
+    [[nodiscard]]
+    double megabytesPerSecond() const;
+};
+
+// Parses text as back to back items like Many(item) followed by End, each part between consecutive bounds
+// on its own thread. Parts get their own State over the whole text limited to the part, so Anchors and errors
+// carry offsets into text. Results come back in input order, on failure State::failure() of the earliest failing part.
+// Every part must consist of whole items, the grammar and stoppables must be safe to share between threads.
+template <typename T>
+requires Exposable<T>
+ParserResult<std::vector<FirstTuple<ExposeType<T>>>> parseParallel(
+    const T &item, std::string_view text, const std::vector<size_t> &bounds,
+    const Stoppable &space, const Stoppable &token, size_t threads = std::thread::hardware_concurrency()) {
+
+    using Result = FirstTuple<ExposeType<T>>;
+
+    size_t parts = bounds.empty() ? 0 : bounds.size() - 1;
+
+    std::vector<std::vector<Result>> results(parts);
+    std::vector<std::optional<ParserResult<>>> outcomes(parts);
+
+    parallelFor(parts, threads, [&](size_t part) {
+        State state(text);
+        state.index = bounds[part];
+        state.count = bounds[part + 1];
+
+        Context context(state, space, token);
+
+        // Every part starts the same way, skipping the space before its first item, so a part parses
+        // the same wherever the bounds put it and leading space in text is accepted like BatchParser does.
+        context.push();
+
+        outcomes[part].emplace(exposeEach(item, context, [&results, part](Result &&result) {
+            results[part].push_back(std::move(result));
+        }));
+
+        if (auto error = outcomes[part]->error())
+            state.report(*error);
+    });
+
+    for (auto &outcome : outcomes) {
+        if (auto error = outcome->error()) {
+            return ParserResult<std::vector<Result>> { outcome->release() };
+        }
+    }
+
+    std::vector<Result> list;
+
+    if (parts == 1) {
+        list = std::move(results.front());
+    } else {
+        size_t total = 0;
+
+        for (const auto &result : results)
+            total += result.size();
+
+        list.reserve(total);
+
+        for (auto &result : results)
+            std::move(result.begin(), result.end(), std::back_inserter(list));
+    }
+
+    return ParserResult<std::vector<Result>> { std::move(list) };
+}
+
+// Parses many independent documents with one shared grammar over a WorkerPool. Each worker keeps its State,
+// memo table and arena between documents: the memo is cleared per document, the arenas are released when
+// the next batch starts, so arena results stay valid until then. Results come back in input order,
+// failed documents with State::failure() of their parse.
+template <typename T>
+requires Exposable<T>
+struct BatchParser {
+    using Result = ExposeResultType<T>;
+
+    struct Worker {
+        State state { std::string_view() };
+        MemoTable memo;
+        std::pmr::monotonic_buffer_resource arena;
+    };
+
+    const T &rule;
+
+    const Stoppable &space;
+    const Stoppable &token;
+
+    WorkerPool pool;
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    bool memoize = false; // give every document the worker's MemoTable
+
+    BatchStats stats;
+
+    std::vector<Result> parse(std::span<const std::string_view> inputs) {
+        auto start = std::chrono::steady_clock::now();
+
+        for (auto &worker : workers)
+            worker->arena.release();
+
+        std::vector<std::optional<Result>> slots(inputs.size());
+
+        pool.run(inputs.size(), [this, &inputs, &slots](size_t index, size_t document) {
+            auto &worker = *workers[index];
+            auto &state = worker.state;
+
+            state.reset(inputs[document]);
+            state.resource = &worker.arena;
+            state.memo = nullptr;
+
+            if (memoize) {
+                worker.memo.clear();
+                state.memo = &worker.memo;
+            }
+
+            Context context(state, space, token);
+            context.push();
+
+            slots[document].emplace(rule.expose(context));
+
+            if (auto error = slots[document]->error())
+                state.report(*error);
+        });
+
+        std::vector<Result> results;
+        results.reserve(inputs.size());
+
+        for (auto &slot : slots) {
+            stats.failures += slot->error() != nullptr;
+
+            results.push_back(std::move(*slot));
+        }
+
+        for (auto input : inputs)
+            stats.bytes += input.size();
+
+        stats.documents += inputs.size();
+        stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        return results;
+    }
+
+    BatchParser(const T &rule, const Stoppable &space, const Stoppable &token,
+        size_t threads = std::thread::hardware_concurrency()) : rule(rule), space(space), token(token), pool(threads) {
+        workers.reserve(pool.size());
+
+        for (size_t a = 0; a < pool.size(); a++)
+            workers.push_back(std::make_unique<Worker>());
+    }
+};
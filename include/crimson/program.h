@@ -0,0 +1,568 @@
+#pragma once
+
+#include <cstring> // Box
+
+#include <crimson/tools.h>
+
+// Grammars lowered into a flat instruction array run by an iterative VM. Sequences, Map, Many, Maybe, Branch,
+// BranchSome, Pick and Wrap become instructions with an explicit backtrack stack and call stack. Anything else
+// runs as a Native instruction calling its expose, with recursion inside it back on the native stack.
+// Values between instructions are boxed. The program points into the grammar it was compiled from, which must outlive it.
+
+// A value on the VM's stack. Values that fit inlineSize and move without throwing live inside the box, so pushing
+// them only writes into the stack's storage, which a parse reuses. Anything else is allocated.
+struct Box {
+    constexpr static size_t inlineSize = 48;
+
+    // How values of one type are destroyed and moved between boxes.
+    struct Type {
+        void (*destroy)(void *storage);
+        void (*relocate)(void *from, void *to); // leaves from without a value
+        bool inlined;
+        bool trivial; // inlined and trivially copyable, moved by copying the storage and never destroyed
+    };
+
+    template <typename T>
+    constexpr static bool fits = sizeof(T) <= inlineSize && alignof(T) <= alignof(std::max_align_t)
+        && std::is_nothrow_move_constructible_v<T>;
+
+    template <typename T>
+    constexpr static bool trivial = fits<T> && std::is_trivially_copyable_v<T>;
+
+    template <typename T>
+    struct Of {
+        static void destroy(void *storage) {
+            if constexpr (fits<T>) {
+                static_cast<T *>(storage)->~T();
+            } else {
+                delete *static_cast<T **>(storage);
+            }
+        }
+
+        static void relocate(void *from, void *to) {
+            if constexpr (fits<T>) {
+                new (to) T(std::move(*static_cast<T *>(from)));
+                static_cast<T *>(from)->~T();
+            } else {
+                *static_cast<T **>(to) = *static_cast<T **>(from);
+            }
+        }
+
+        constexpr static Type type { destroy, relocate, fits<T>, trivial<T> };
+    };
+
+    alignas(std::max_align_t) std::byte storage[inlineSize];
+    const Type *type = nullptr;
+
+    [[nodiscard]]
+    void *get() const {
+        auto *pointer = const_cast<std::byte *>(storage); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+
+        return type->inlined ? pointer : *reinterpret_cast<void **>(pointer);
+    }
+
+    void reset() {
+        if (type && !type->trivial)
+            type->destroy(storage);
+
+        type = nullptr;
+    }
+
+    // Takes the value of other, which must be set, into this box, which must not.
+    void take(Box &other) noexcept {
+        type = std::exchange(other.type, nullptr);
+
+        if (type->trivial) {
+            std::memcpy(storage, other.storage, inlineSize);
+        } else {
+            type->relocate(other.storage, storage);
+        }
+    }
+
+    template <typename T>
+    requires (!std::same_as<std::decay_t<T>, Box>)
+    explicit Box(T &&value) : type(&Of<std::decay_t<T>>::type) {
+        using Value = std::decay_t<T>;
+
+        if constexpr (fits<Value>) {
+            new (storage) Value(std::forward<T>(value));
+        } else {
+            *reinterpret_cast<Value **>(storage) = new Value(std::forward<T>(value));
+        }
+    }
+
+    Box(Box &&other) noexcept {
+        if (other.type)
+            take(other);
+    }
+
+    Box &operator=(Box &&other) noexcept {
+        if (this != &other) {
+            reset();
+
+            if (other.type)
+                take(other);
+        }
+
+        return *this;
+    }
+
+    Box(const Box &other) = delete;
+
+    ~Box() {
+        reset();
+    }
+};
+
+template <typename T>
+Box box(T &&value) {
+    return Box { std::forward<T>(value) };
+}
+
+template <typename T>
+T &unbox(const Box &value) {
+    return *static_cast<T *>(value.get());
+}
+
+// Calls into the grammar. Pops what it consumes from values and pushes its results, mark is the stack size
+// recorded by the matching Mark for Collect and 0 otherwise.
+struct Native {
+    std::unique_ptr<Error> (*call)(const void *data, Context &context, std::vector<Box> &values, size_t mark);
+    const void *data;
+};
+
+struct Instruction {
+    enum class Op : uint8_t {
+        Native, // run natives[native]
+        Mark, // remember the value stack size
+        Collect, // run natives[native] on everything since the last Mark
+        Choice, // on failure come back to target with the state as it is now
+        Commit, // drop the last Choice and jump to target
+        PartialCommit, // move the last Choice up to the current state and jump to target
+        Call, // run the subroutine at target
+        Return,
+        Jump,
+        Guard, // jump to target when the next byte can't start what follows, as FirstDispatch skips alternatives
+        Halt,
+    };
+
+    // What a failure does when it reaches a Choice.
+    enum class Mode : uint8_t {
+        Alternative, // Branch alternative: retried unless the error is matched, runs with matched reset
+        Last, // last Branch alternative: always fails on, runs with matched reset
+        Optional, // Maybe: retried unless a Cut committed past it
+        Repeat, // Many: retried unless the error is matched
+    };
+
+    Op op;
+    Mode mode = Mode::Alternative;
+    bool reset = false; // Call: the subroutine starts with matched cleared like AnyRule's own context
+
+    uint32_t target = 0;
+    uint32_t native = 0; // index into natives, or into guards for Guard
+};
+
+// Bytes an alternative can start on and the literal reported when it is skipped, like FirstDispatch::skipped.
+struct Guard {
+    std::bitset<256> bytes;
+    std::string_view literal;
+};
+
+// What programs keep while they run. It lives on State::stacks, so programs run once per item reuse the storage
+// of the previous item instead of allocating their stacks again.
+struct ProgramStacks {
+    struct Backtrack {
+        uint32_t target;
+        Instruction::Mode mode;
+
+        bool matched; // of the context around the Choice
+
+        size_t index;
+        size_t recorded;
+        size_t values;
+        size_t marks;
+        size_t frames;
+    };
+
+    struct Frame {
+        uint32_t ret;
+
+        bool matched;
+        bool restore;
+    };
+
+    std::vector<Box> values;
+    std::vector<Backtrack> backtracks;
+    std::vector<Frame> frames;
+    std::vector<size_t> marks;
+
+    // The stacks of state, created on first use.
+    static ProgramStacks &of(State &state);
+};
+
+struct ProgramCode {
+    std::vector<Instruction> instructions;
+    std::vector<Native> natives;
+    std::vector<Guard> guards;
+
+    // Runs from the first instruction, pushing the results on stacks.values or returning the error.
+    std::unique_ptr<Error> run(Context &context, ProgramStacks &stacks) const;
+};
+
+struct ProgramBuilder {
+    ProgramCode code;
+
+    // Targets are label numbers while building, finish() turns them into addresses.
+    std::vector<uint32_t> labels;
+
+    struct Subroutine {
+        uint32_t label;
+
+        const void *rule;
+        void (*lower)(const void *rule, ProgramBuilder &builder);
+    };
+
+    std::unordered_map<const void *, uint32_t> subroutines;
+    std::vector<Subroutine> pending;
+
+    [[nodiscard]]
+    uint32_t label();
+
+    void bind(uint32_t label);
+
+    void emit(Instruction instruction);
+    void emitNative(Native native);
+    void emitCollect(Native native);
+
+    // Skips to label unless the next byte is in first, emits nothing when first accepts every byte.
+    void emitGuard(const FirstSet &first, uint32_t label);
+
+    // Label of the subroutine for rule, lowered once at the end however many Wraps call it.
+    [[nodiscard]]
+    uint32_t subroutine(const void *rule, void (*lower)(const void *rule, ProgramBuilder &builder));
+
+    // Lowers pending subroutines and resolves labels.
+    [[nodiscard]]
+    ProgramCode finish();
+};
+
+template <typename Tuple, size_t ...Is>
+Tuple takeTuple(std::vector<Box> &values, size_t base, std::index_sequence<Is...>) {
+    return Tuple(std::move(unbox<std::tuple_element_t<Is, Tuple>>(values[base + Is]))...);
+}
+
+template <typename Tuple>
+struct Program;
+
+template <typename ...Args>
+struct Program<std::tuple<Args...>>: public RuleModifiers<Program<std::tuple<Args...>>> {
+    ProgramCode code;
+
+    ParserResult<Args...> expose(Context &context) const {
+        auto &values = ProgramStacks::of(context.state).values;
+
+        size_t base = values.size();
+
+        if (auto error = code.run(context, ProgramStacks::of(context.state))) {
+            values.erase(values.begin() + static_cast<std::ptrdiff_t>(base), values.end());
+
+            return ParserResult<Args...> { std::move(error) };
+        }
+
+        auto result = takeTuple<std::tuple<Args...>>(values, base, std::index_sequence_for<Args...> { });
+        values.erase(values.begin() + static_cast<std::ptrdiff_t>(base), values.end());
+
+        return ParserResult<Args...> { std::move(result) };
+    }
+
+    explicit Program(ProgramCode code) : code(std::move(code)) { }
+};
+
+// Pops the values of a tuple of type Tuple off the stack.
+template <typename Tuple>
+Tuple popTuple(std::vector<Box> &values) {
+    constexpr size_t size = std::tuple_size_v<Tuple>;
+
+    size_t base = values.size() - size;
+
+    auto tuple = takeTuple<Tuple>(values, base, std::make_index_sequence<size> { });
+    values.erase(values.begin() + static_cast<std::ptrdiff_t>(base), values.end());
+
+    return tuple;
+}
+
+template <typename T>
+std::unique_ptr<Error> exposeNative(const void *data, Context &context, std::vector<Box> &values, size_t) {
+    auto result = expose(*static_cast<const T *>(data), context);
+
+    if (result.error()) {
+        return result.release();
+    }
+
+    std::apply([&values](auto &...value) { (values.emplace_back(std::move(value)), ...); }, *result.ptr());
+
+    return nullptr;
+}
+
+template <typename T, typename K>
+std::unique_ptr<Error> mapNative(const void *data, Context &, std::vector<Box> &values, size_t) {
+    const auto &rule = *static_cast<const Map<T, K> *>(data);
+
+    values.emplace_back(rule.map(popTuple<ExposeType<T>>(values)));
+
+    return nullptr;
+}
+
+template <typename Result>
+std::unique_ptr<Error> collectNative(const void *, Context &, std::vector<Box> &values, size_t mark) {
+    std::vector<Result> list;
+    list.reserve(values.size() - mark);
+
+    for (size_t a = mark; a < values.size(); a++)
+        list.push_back(std::move(unbox<Result>(values[a])));
+
+    values.erase(values.begin() + static_cast<std::ptrdiff_t>(mark), values.end());
+    values.emplace_back(std::move(list));
+
+    return nullptr;
+}
+
+template <typename Result>
+std::unique_ptr<Error> someNative(const void *, Context &, std::vector<Box> &values, size_t) {
+    values.back() = box(std::optional<Result> { std::move(unbox<Result>(values.back())) });
+
+    return nullptr;
+}
+
+template <typename Result>
+std::unique_ptr<Error> noneNative(const void *, Context &, std::vector<Box> &values, size_t) {
+    values.emplace_back(std::optional<Result> { });
+
+    return nullptr;
+}
+
+inline std::unique_ptr<Error> monostateNative(const void *, Context &, std::vector<Box> &values, size_t) {
+    values.emplace_back(std::monostate { });
+
+    return nullptr;
+}
+
+template <typename Variant, size_t index, typename Tuple>
+std::unique_ptr<Error> variantNative(const void *, Context &, std::vector<Box> &values, size_t) {
+    values.emplace_back(Variant(std::in_place_index<index>, popTuple<Tuple>(values)));
+
+    return nullptr;
+}
+
+template <typename Variant, size_t index, typename Result>
+std::unique_ptr<Error> variantFirstNative(const void *, Context &, std::vector<Box> &values, size_t) {
+    values.back() = box(Variant(std::in_place_index<index>, std::move(unbox<Result>(values.back()))));
+
+    return nullptr;
+}
+
+// Anything without its own lowering runs through its expose.
+template <typename T>
+void lower(const T &rule, ProgramBuilder &builder) {
+    builder.emitNative({ exposeNative<T>, &rule });
+}
+
+// Leaves exactly one value for an item of T, as getTupleFirst does for Many, Maybe and Branch.
+template <typename T>
+void lowerFirst(const T &rule, ProgramBuilder &builder) {
+    lower(rule, builder);
+
+    if constexpr (std::tuple_size_v<ExposeType<T>> == 0) {
+        builder.emitNative({ monostateNative, nullptr });
+    }
+}
+
+template <typename ...Args>
+void lower(const Rule<Args...> &rule, ProgramBuilder &builder) {
+    std::apply([&builder](const auto &...component) { (lower(component, builder), ...); }, rule.components);
+}
+
+template <typename T, typename K>
+void lower(const Map<T, K> &rule, ProgramBuilder &builder) {
+    lower(rule.value, builder);
+
+    builder.emitNative({ mapNative<T, K>, &rule });
+}
+
+template <typename T>
+void lower(const Many<T> &rule, ProgramBuilder &builder) {
+    using Op = Instruction::Op;
+
+    auto loop = builder.label();
+    auto exit = builder.label();
+
+    builder.emit({ Op::Mark });
+    builder.emit({ Op::Choice, Instruction::Mode::Repeat, false, exit });
+    builder.bind(loop);
+
+    lowerFirst(rule.value, builder);
+
+    builder.emit({ Op::PartialCommit, Instruction::Mode::Repeat, false, loop });
+    builder.bind(exit);
+    builder.emitCollect({ collectNative<typename Many<T>::Result>, nullptr });
+}
+
+template <typename T>
+void lower(const Maybe<T> &rule, ProgramBuilder &builder) {
+    using Op = Instruction::Op;
+    using Result = typename Maybe<T>::Result;
+
+    auto none = builder.label();
+    auto some = builder.label();
+    auto end = builder.label();
+
+    builder.emit({ Op::Choice, Instruction::Mode::Optional, false, none });
+
+    lowerFirst(rule.value, builder);
+
+    builder.emit({ Op::Commit, Instruction::Mode::Optional, false, some });
+    builder.bind(none);
+    builder.emitNative({ noneNative<Result>, nullptr });
+    builder.emit({ Op::Jump, Instruction::Mode::Optional, false, end });
+    builder.bind(some);
+    builder.emitNative({ someNative<Result>, nullptr });
+    builder.bind(end);
+}
+
+// Every alternative runs under a Choice that resets matched like the sub-context of anyOfTupleSized,
+// the last one fails on whatever happens. The others are guarded by their first bytes like in FirstDispatch. convert turns alternative index's values into the result.
+template <size_t index, typename ...Args, typename Convert>
+void lowerAlternatives(const std::tuple<Args...> &components, ProgramBuilder &builder, uint32_t end, Convert &&convert) {
+    using Op = Instruction::Op;
+
+    if constexpr (index < sizeof...(Args)) {
+        constexpr bool last = index + 1 == sizeof...(Args);
+
+        auto next = builder.label();
+
+        if constexpr (!last) {
+            builder.emitGuard(firstSet(std::get<index>(components)), next);
+        }
+
+        builder.emit({ Op::Choice, last ? Instruction::Mode::Last : Instruction::Mode::Alternative, false, next });
+
+        convert(std::integral_constant<size_t, index> { }, std::get<index>(components));
+
+        builder.emit({ Op::Commit, Instruction::Mode::Alternative, false, end });
+        builder.bind(next);
+
+        lowerAlternatives<index + 1>(components, builder, end, convert);
+    }
+}
+
+template <typename ...Args>
+void lower(const Branch<Args...> &rule, ProgramBuilder &builder) {
+    using Variant = FirstResultVariant<Args...>;
+
+    auto end = builder.label();
+
+    lowerAlternatives<0>(rule.components, builder, end, [&builder](auto index, const auto &component) {
+        using Component = std::decay_t<decltype(component)>;
+
+        lowerFirst(component, builder);
+        builder.emitNative({ variantFirstNative<Variant, index, FirstTuple<ExposeType<Component>>>, nullptr });
+    });
+
+    builder.bind(end);
+}
+
+template <typename ...Args>
+void lower(const BranchSome<Args...> &rule, ProgramBuilder &builder) {
+    using Variant = ResultVariant<Args...>;
+
+    auto end = builder.label();
+
+    lowerAlternatives<0>(rule.components, builder, end, [&builder](auto index, const auto &component) {
+        using Component = std::decay_t<decltype(component)>;
+
+        lower(component, builder);
+        builder.emitNative({ variantNative<Variant, index, ExposeType<Component>>, nullptr });
+    });
+
+    builder.bind(end);
+}
+
+template <typename ...Args>
+void lower(const Pick<Args...> &rule, ProgramBuilder &builder) {
+    auto end = builder.label();
+
+    lowerAlternatives<0>(rule.components, builder, end, [&builder](auto, const auto &component) {
+        lower(component, builder);
+    });
+
+    builder.bind(end);
+}
+
+// Marks the rule an AnyRule holds as one compile() can lower, define recursive rules as AnyRule(compilable(rule))
+// for Wraps of them to become calls into the program. Only AnyRules built this way pay for the lowering code.
+template <typename T>
+requires Exposable<T>
+struct Compilable: public RuleModifiers<Compilable<T>> {
+    T value;
+
+    static void lowering(const void *rule, ProgramBuilder &builder);
+
+    auto expose(Context &context) const {
+        return value.expose(context);
+    }
+
+    FirstSet first() const {
+        return firstSet(value);
+    }
+
+    explicit Compilable(T &&value) : value(std::forward<T>(value)) { }
+};
+
+template <typename T>
+auto compilable(T &&rule) {
+    return Compilable<std::decay_t<T>> { std::decay_t<T>(std::forward<T>(rule)) };
+}
+
+template <typename T>
+void lower(const Compilable<T> &rule, ProgramBuilder &builder) {
+    lower(rule.value, builder);
+}
+
+template <typename T>
+requires Exposable<T>
+void Compilable<T>::lowering(const void *rule, ProgramBuilder &builder) {
+    lower(static_cast<const Compilable<T> *>(rule)->value, builder);
+}
+
+template <typename ...Produces>
+void lower(const Wrap<Produces...> &rule, ProgramBuilder &builder) {
+    const auto *target = rule.rule;
+
+    if (!target->lower) {
+        builder.emitNative({ exposeNative<Wrap<Produces...>>, &rule });
+
+        return;
+    }
+
+    auto label = builder.subroutine(target->value.get(), target->lower);
+
+    builder.emit({ Instruction::Op::Call, Instruction::Mode::Alternative, target->autoContext, label });
+}
+
+// Lowers rule into a Program, itself a rule producing the same values.
+// Only recursion through Wraps of AnyRules built from compilable() and the combinators listed at the top of this
+// file is bounded by the heap. Everything else, Memo, SepBy, Operators, Recover, MapInto, MatchOn, Debug and
+// Profile among them, runs natively and nests on the C++ stack like a recursive parse, as does a Wrap of a plain
+// AnyRule. Grammars that recurse deeply through those still need stack room for that depth.
+// Compile for depth, not speed: a program runs slower than the rules it came from, the json-vm and expression-vm
+// cases of crimson_bench measure by how much (about 0.7 to 0.9 times the throughput of the rules when written).
+template <typename T>
+requires Exposable<T>
+auto compile(const T &rule) {
+    ProgramBuilder builder;
+
+    lower(rule, builder);
+    builder.emit({ Instruction::Op::Halt });
+
+    return Program<ExposeType<T>> { builder.finish() };
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <crimson/tools.h>
+#include <crimson/input.h>
+
+#include <mutex>
+#include <limits>
+#include <thread>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+// Source filled from another thread, read waits until feed or finish supplies something.
+// At most limit bytes wait to be read, feed blocks until the reader makes room for the rest.
+struct FeedSource: public Source {
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::condition_variable drained;
+
+    std::string pending;
+    size_t offset = 0; // bytes of pending already read
+
+    size_t limit;
+
+    bool finished = false;
+    bool closed = false;
+
+    [[nodiscard]]
+    size_t read(char *data, size_t size) override;
+
+    void feed(std::string_view data);
+    void finish();
+
+    // The reader is gone, feed drops what it is given instead of waiting for room.
+    void close();
+
+    explicit FeedSource(size_t limit = std::numeric_limits<size_t>::max());
+};
+
+// Starts the work it is given somewhere else, a thread pool for instance. The work blocks while it waits for bytes.
+using StreamExecutor = std::function<void(std::function<void()>)>;
+
+// Push-style driver for inputs that arrive in fragments (sockets, pipes). feed() hands over bytes as they come,
+// each complete item is passed to callback as soon as the bytes deciding it have arrived.
+// Combinators call into each other on the native stack, so a stackless coroutine could not suspend inside them.
+// Instead the parse runs on its own thread and suspends in FeedSource::read whenever it needs bytes not fed yet.
+// The callback runs on that thread, started by executor or a std::thread of the parser's own without one.
+// One parser per TCP connection means one blocked thread per connection, size executors for that.
+// feed blocks while limit bytes wait for the parse, on top of the limit bytes ChunkedInput may keep.
+template <typename T, typename Callback>
+requires Exposable<T>
+struct StreamParser {
+    const T &rule;
+    Callback callback;
+
+    FeedSource source;
+    ChunkedInput input;
+    State state;
+    Context context;
+
+    std::optional<ParserResult<>> result;
+    std::exception_ptr exception;
+
+    std::mutex mutex;
+    std::condition_variable stopped;
+    bool done = false;
+
+    std::thread worker;
+
+    void run() {
+        try {
+            result.emplace(exposeEach(rule, context, callback));
+
+            if (auto error = result->error())
+                state.report(*error);
+        } catch (...) {
+            exception = std::current_exception();
+        }
+
+        source.close();
+
+        {
+            std::lock_guard lock(mutex);
+
+            done = true;
+        }
+
+        stopped.notify_all();
+    }
+
+    void wait() {
+        std::unique_lock lock(mutex);
+
+        stopped.wait(lock, [this]() { return done; });
+        lock.unlock();
+
+        if (worker.joinable())
+            worker.join();
+    }
+
+    void feed(std::string_view data) {
+        source.feed(data);
+    }
+
+    // Ends the input and waits for the parse to finish, rethrowing anything the parse threw.
+    // A failed parse reports State::failure().
+    ParserResult<> finish() {
+        source.finish();
+
+        wait();
+
+        if (exception)
+            std::rethrow_exception(exception);
+
+        return std::move(*result);
+    }
+
+    StreamParser(const T &rule, const Stoppable &space, const Stoppable &token, Callback callback,
+        size_t chunk = 1 << 16, size_t limit = 1 << 30, const StreamExecutor &executor = { })
+        : rule(rule), callback(std::move(callback)), source(limit), input(source, chunk, limit), state(input),
+        context(state, space, token) {
+        if (executor)
+            executor([this]() { run(); });
+        else
+            worker = std::thread([this]() { run(); });
+    }
+
+    ~StreamParser() {
+        source.finish();
+
+        wait();
+    }
+
+    StreamParser(const StreamParser &other) = delete;
+};
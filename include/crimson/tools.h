@@ -1,6 +1,9 @@
 #pragma once
 
+#include <chrono> // Profile
+#include <charconv> // Integer, Float
 #include <iostream> // Debug
+#include <stdexcept> // InternToken, SepBy
 
 #include <crimson/crimson.h>
 
@@ -44,6 +47,10 @@ template <typename T>
 requires Exposable<T>
 struct Maybe;
 
+template <typename T>
+requires Exposable<T>
+struct Recover;
+
 template <typename T, typename K>
 requires Exposable<T>
 struct Map;
@@ -80,6 +87,30 @@ template <typename T, typename StoppableType>
 requires Exposable<T>
 struct SetStoppable;
 
+template <typename T>
+requires Exposable<T>
+struct Memo;
+
+template <typename T>
+requires Exposable<T>
+struct Profile;
+
+template <typename T, typename Separator>
+requires Exposable<T> && Exposable<Separator>
+struct SepBy;
+
+struct NoSeparator;
+
+struct Repeat;
+
+template <typename T>
+requires Exposable<T>
+struct ArenaMany;
+
+template <typename T>
+requires Exposable<T>
+struct MakeArena;
+
 template <typename T, typename Tuple, std::size_t ... Is>
 constexpr T makeStructFromTupleHelper(Tuple &&t, std::index_sequence<Is...>) {
     return T { std::get<Is>(std::forward<Tuple>(t))... };
@@ -91,6 +122,16 @@ constexpr T makeStructFromTuple(Tuple&& t) {
     return makeStructFromTupleHelper<T>(std::forward<Tuple>(t), std::make_index_sequence<tuple_size> { });
 }
 
+// Rules report the bytes they can start on through first(), anything else is treated as unknown.
+template <typename T>
+FirstSet firstSet(const T &value) {
+    if constexpr (requires { { value.first() } -> std::same_as<FirstSet>; }) {
+        return value.first();
+    } else {
+        return FirstSet::unknown();
+    }
+}
+
 template <typename Self>
 struct RuleModifiers {
     Self &&self() {
@@ -124,10 +165,27 @@ struct RuleModifiers {
         return Many<Self> { self() };
     }
 
+    auto many(const Repeat &repeat);
+
+    template <typename Separator>
+    auto sepBy(Separator &&separator, const Repeat &repeat);
+
+    template <typename Separator>
+    auto sepBy(Separator &&separator);
+
+    auto manyArena() {
+        return ArenaMany<Self> { self() };
+    }
+
     auto maybe() {
         return Maybe<Self> { self() };
     }
 
+    // With State::diagnostics set, failures past the start are recorded and skipped up to the next of stops.
+    auto recover(const std::vector<std::string_view> &stops) {
+        return Recover<Self> { self(), stops };
+    }
+
     template <typename K>
     auto map(K &&map) {
         return Map<Self, K> { self(), std::forward<K>(map) };
@@ -164,6 +222,10 @@ struct RuleModifiers {
         } };
     }
 
+    auto makeArena() {
+        return MakeArena<Self> { self() };
+    }
+
     template <typename K>
     auto mapInto(K &&map) {
         return MapInto<Self, K> { self(), std::forward<K>(map) };
@@ -199,6 +261,21 @@ struct RuleModifiers {
     auto debug(std::string name) {
         return Debug<Self> { std::move(name), self() };
     }
+
+    // Counts calls into ProfileCounters::get(name). Without CRIMSON_PROFILE defined this returns the rule unchanged.
+    auto profile(std::string_view name) {
+#ifdef CRIMSON_PROFILE
+        return Profile<Self> { ProfileCounters::get(name), self() };
+#else
+        (void) name;
+
+        return Self { self() };
+#endif
+    }
+
+    auto memo() {
+        return Memo<Self> { self() };
+    }
 };
 
 struct Push: public RuleModifiers<Push> {
@@ -211,18 +288,29 @@ struct Push: public RuleModifiers<Push> {
 
 struct End: public RuleModifiers<End> {
     ParserResult<> expose(Context &context) const {
-        if (context.state.count == context.state.index) {
+        if (!context.state.ensure(context.state.index + 1)) {
             return ParserResult<> { std::make_tuple() };
         }
 
         return context.error<>(ErrorMustEnd { });
     }
+
+    // Never matches on a byte, only at the end of the input.
+    FirstSet first() const { // NOLINT(readability-convert-member-functions-to-static)
+        return FirstSet { };
+    }
 };
 
 struct Anchor: public RuleModifiers<Anchor> {
     ParserResult<size_t> expose(Context &context) const {
+        context.state.anchors++;
+
         return ParserResult<size_t> { std::make_tuple(context.state.index) };
     }
+
+    FirstSet first() const { // NOLINT(readability-convert-member-functions-to-static)
+        return FirstSet::empty();
+    }
 };
 
 struct Text: public RuleModifiers<Text> {
@@ -235,7 +323,11 @@ struct Text: public RuleModifiers<Text> {
 
         context.pop(text.size());
 
-        return ParserResult<> { { } };
+        return ParserResult<> { std::make_tuple() };
+    }
+
+    FirstSet first() const {
+        return FirstSet::of(text);
     }
 
     explicit Text(std::string text) : text(std::move(text)) { }
@@ -258,9 +350,87 @@ struct Keyword: public RuleModifiers<Keyword> {
         return ParserResult<> { std::make_tuple() };
     }
 
+    FirstSet first() const {
+        return FirstSet::of(text);
+    }
+
     explicit Keyword(std::string text) : text(std::move(text)) { }
 };
 
+// Longest of texts matching the input in a single pass over it, as its index in texts.
+// Keywords must also be followed by a token stop like Keyword, falling back to shorter keywords that are.
+template <bool keywords>
+struct LiteralSet: public RuleModifiers<LiteralSet<keywords>> {
+    std::vector<std::string> texts;
+    LiteralTrie trie;
+
+    // Shared by every ErrorExpectedOneOf this reports, so a miss doesn't copy the set.
+    std::shared_ptr<const std::vector<std::string_view>> views;
+
+    ParserResult<size_t> expose(Context &context) const {
+        auto node = trie.deepest(context.pull(trie.longest));
+        auto deepest = node;
+
+        while (node >= 0) {
+            const auto &match = trie.nodes[node];
+
+            if (!keywords || context.ends(match.depth)) {
+                context.pop(match.depth);
+
+                return ParserResult<size_t> { std::make_tuple(static_cast<size_t>(match.value)) };
+            }
+
+            node = match.shorter;
+        }
+
+        if (deepest >= 0) {
+            return context.error<size_t>(ErrorRequiresSpaceAfter { texts[trie.nodes[deepest].value] });
+        }
+
+        return context.error<size_t>(ErrorExpectedOneOf { views });
+    }
+
+    FirstSet first() const {
+        FirstSet result;
+
+        for (const auto &text : texts) {
+            if (!text.empty())
+                result.bytes.set(static_cast<uint8_t>(text.front()));
+        }
+
+        return result;
+    }
+
+    explicit LiteralSet(std::vector<std::string> texts)
+        : texts(std::move(texts)), trie(this->texts), views(viewsOf(this->texts)) { }
+
+    // The views point into texts, rebuild them wherever a copy ends up.
+    LiteralSet(const LiteralSet &other) : texts(other.texts), trie(other.trie), views(viewsOf(texts)) { }
+    LiteralSet(LiteralSet &&other) noexcept = default;
+
+    static std::shared_ptr<const std::vector<std::string_view>> viewsOf(const std::vector<std::string> &texts) {
+        return std::make_shared<const std::vector<std::string_view>>(texts.begin(), texts.end());
+    }
+};
+
+using TextSet = LiteralSet<false>;
+using KeywordSet = LiteralSet<true>;
+
+// View variants point into State::text and are only valid while the input is alive.
+struct TokenView: public RuleModifiers<TokenView> {
+    ParserResult<std::string_view> expose(Context &context) const { // NOLINT(readability-convert-member-functions-to-static)
+        size_t size = context.state.until(context.token);
+
+        if (size <= 0)
+            return context.error<std::string_view>(ErrorMissingToken { });
+
+        auto text = context.pull(size);
+        context.pop(size);
+
+        return ParserResult<std::string_view> { text };
+    }
+};
+
 struct Token: public RuleModifiers<Token> {
     ParserResult<std::string> expose(Context &context) const { // NOLINT(readability-convert-member-functions-to-static)
         size_t size = context.state.until(context.token);
@@ -275,12 +445,159 @@ struct Token: public RuleModifiers<Token> {
     }
 };
 
+// Converts the number at the index straight from the loaded input with convert(begin, end, value), a std::from_chars
+// call, after an optional "0" prefix letter. The number must end where the token stoppable stops, as a Token would.
+// Chunked inputs load more while the digits run into the end of what is loaded.
+template <typename T, typename Convert>
+ParserResult<T> exposeNumber(Context &context, char prefix, Convert &&convert) {
+    auto &state = context.state;
+
+    size_t skip = 0;
+
+    if (prefix) {
+        if (!state.ensure(state.index + 2) || *state.data(state.index) != '0'
+            || (*state.data(state.index + 1) | 0x20) != prefix)
+            return context.error<T>(ErrorExpectedNumber { });
+
+        skip = 2;
+    }
+
+    size_t start = state.index + skip;
+
+    if (!state.ensure(start + 1) || (prefix && *state.data(start) == '-'))
+        return context.error<T>(ErrorExpectedNumber { });
+
+    T value { };
+    std::from_chars_result result;
+
+    while (true) {
+        const char *end = state.data(state.count);
+
+        result = convert(state.data(start), end, value);
+
+        if (result.ptr != end || !state.input || !state.ensure(state.count + 1))
+            break;
+    }
+
+    size_t size = skip + static_cast<size_t>(result.ptr - state.data(start));
+
+    if (result.ec == std::errc::invalid_argument || !context.ends(size))
+        return context.error<T>(ErrorExpectedNumber { });
+
+    if (result.ec == std::errc::result_out_of_range)
+        return context.error<T>(ErrorNumberOutOfRange { std::string(context.pull(size)) });
+
+    context.pop(size);
+
+    return ParserResult<T> { value };
+}
+
+// Integer token in base, without allocating. Base 16, 8 and 2 take a 0x, 0o or 0b prefix (any case).
+// Values that do not fit in T fail with ErrorNumberOutOfRange.
+template <typename T, int base = 10>
+requires std::integral<T>
+struct Integer: public RuleModifiers<Integer<T, base>> {
+    constexpr static char prefix = base == 16 ? 'x' : base == 8 ? 'o' : base == 2 ? 'b' : '\0';
+
+    ParserResult<T> expose(Context &context) const { // NOLINT(readability-convert-member-functions-to-static)
+        return exposeNumber<T>(context, prefix, [](const char *begin, const char *end, T &value) {
+            return std::from_chars(begin, end, value, base);
+        });
+    }
+
+    FirstSet first() const { // NOLINT(readability-convert-member-functions-to-static)
+        if (!prefix && base != 10)
+            return FirstSet::unknown();
+
+        FirstSet result;
+        result.bytes.set('0');
+
+        for (char digit = '1'; digit <= '9' && !prefix; digit++)
+            result.bytes.set(static_cast<uint8_t>(digit));
+
+        if (std::is_signed_v<T> && !prefix)
+            result.bytes.set('-');
+
+        return result;
+    }
+};
+
+template <typename T>
+using Hex = Integer<T, 16>;
+
+template <typename T>
+using Binary = Integer<T, 2>;
+
+// Floating point token in std::chars_format::general (decimal and exponent forms, inf and nan), without allocating.
+template <typename T>
+requires std::floating_point<T>
+struct Float: public RuleModifiers<Float<T>> {
+    ParserResult<T> expose(Context &context) const { // NOLINT(readability-convert-member-functions-to-static)
+        return exposeNumber<T>(context, '\0', [](const char *begin, const char *end, T &value) {
+            return std::from_chars(begin, end, value, std::chars_format::general);
+        });
+    }
+};
+
+// Token as a Symbol from table, or from State::symbols when no table is given. Repeated identifiers
+// cost a hash lookup instead of a string each, and compare as integers afterwards.
+struct InternToken: public RuleModifiers<InternToken> {
+    SymbolTable *table = nullptr;
+
+    ParserResult<Symbol> expose(Context &context) const {
+        SymbolTable *symbols = table ? table : context.state.symbols;
+
+        if (!symbols)
+            throw std::logic_error("InternToken needs a symbol table, pass one or set State::symbols.");
+
+        size_t size = context.state.until(context.token);
+
+        if (size <= 0)
+            return context.error<Symbol>(ErrorMissingToken { });
+
+        auto symbol = symbols->intern(context.pull(size));
+        context.pop(size);
+
+        return ParserResult<Symbol> { symbol };
+    }
+
+    InternToken() = default;
+    explicit InternToken(SymbolTable &table) : table(&table) { }
+};
+
+struct ArenaToken: public RuleModifiers<ArenaToken> {
+    ParserResult<std::pmr::string> expose(Context &context) const { // NOLINT(readability-convert-member-functions-to-static)
+        size_t size = context.state.until(context.token);
+
+        if (size <= 0)
+            return context.error<std::pmr::string>(ErrorMissingToken { });
+
+        std::pmr::string text(context.pull(size), context.resource());
+        context.pop(size);
+
+        return ParserResult<std::pmr::string> { std::move(text) };
+    }
+};
+
+struct UntilView: public RuleModifiers<UntilView> {
+    StringStops stoppable;
+
+    ParserResult<std::string_view> expose(Context &context) const {
+        auto size = context.state.until(stoppable);
+
+        auto text = context.pull(size);
+        context.pop(size);
+
+        return ParserResult<std::string_view> { text };
+    }
+
+    explicit UntilView(const std::vector<std::string_view> &stops) : stoppable(stops) { }
+};
+
 struct Until: public RuleModifiers<Until> {
-    std::vector<std::string_view> stops;
+    StringStops stoppable;
 
     ParserResult<std::string> expose(Context &context) const {
-        StringStops stoppable { stops };
-
         auto size = context.state.until(stoppable);
 
         std::string text(context.pull(size));
@@ -289,7 +606,23 @@ struct Until: public RuleModifiers<Until> {
         return ParserResult<std::string> { text };
     }
 
-    explicit Until(std::vector<std::string_view> stops) : stops(std::move(stops)) { }
+    explicit Until(const std::vector<std::string_view> &stops) : stoppable(stops) { }
+};
+
+template <typename StoppableType>
+struct UntilStoppableView: public RuleModifiers<UntilStoppableView<StoppableType>> {
+    StoppableType stoppable;
+
+    ParserResult<std::string_view> expose(Context &context) const {
+        auto size = context.state.until(stoppable);
+
+        auto text = context.pull(size);
+        context.pop(size);
+
+        return ParserResult<std::string_view> { text };
+    }
+
+    explicit UntilStoppableView(StoppableType &&stoppable) : stoppable(std::forward<StoppableType>(stoppable)) { }
 };
 
 template <typename StoppableType>
@@ -325,6 +658,10 @@ struct SetStoppable: public RuleModifiers<SetStoppable<T, StoppableType>> {
         return result;
     }
 
+    FirstSet first() const {
+        return firstSet(value);
+    }
+
     SetStoppable(T &&value, StoppableType &&stoppable)
         : value(std::forward<T>(value)), stoppable(std::forward<StoppableType>(stoppable)) { }
 };
@@ -341,6 +678,10 @@ struct MatchContext: public RuleModifiers<MatchContext<T>> {
         return value.expose(subContext);
     }
 
+    FirstSet first() const {
+        return firstSet(value);
+    }
+
     explicit MatchContext(T &&value) : value(std::forward<T>(value)) { }
 };
 
@@ -352,6 +693,20 @@ struct Match: public RuleModifiers<Match> {
     }
 };
 
+// Commits the parse to everything before it. Branch, Maybe and Many that started earlier turn later failures into
+// matched errors instead of retrying, and memo entries and chunked input before the cut are dropped.
+struct Cut: public RuleModifiers<Cut> {
+    ParserResult<> expose(Context &context) const { // NOLINT(readability-convert-member-functions-to-static)
+        context.state.commit(context.state.index);
+
+        return ParserResult<> { std::make_tuple() };
+    }
+
+    FirstSet first() const { // NOLINT(readability-convert-member-functions-to-static)
+        return FirstSet::empty();
+    }
+};
+
 template <typename T>
 requires Exposable<T>
 struct Discard: public RuleModifiers<Discard<T>> {
@@ -424,6 +779,7 @@ struct Maybe: public RuleModifiers<Maybe<T>> {
 
     ParserResult<std::optional<Result>> expose(Context &context) const {
         size_t start = context.state.index;
+        size_t recorded = context.state.recorded();
 
         auto result = value.expose(context);
 
@@ -434,13 +790,83 @@ struct Maybe: public RuleModifiers<Maybe<T>> {
         }
 
         context.state.index = start;
+        context.state.forget(recorded);
+
+        if (context.state.committed > start) {
+            auto error = result.error();
+            error->matched = true;
+
+            return ParserResult<std::optional<Result>> { result.release() };
+        }
+
+        context.state.recycle(result.release());
 
         return ParserResult<std::optional<Result>> { std::nullopt };
     }
 
+    FirstSet first() const {
+        auto result = firstSet(value);
+        result.nullable = true;
+
+        return result;
+    }
+
     Maybe(T &&value) : value(std::forward<T>(value)) { }
 };
 
+// Error recovery for one designated rule, usually a statement or declaration. Without State::diagnostics this
+// only wraps the result in an optional. With it, an error that is matched or lies past where the rule started
+// is appended to the diagnostics, the input is skipped from the error up to the next of stops (or the end)
+// and the rule produces std::nullopt in place of its result so the parse goes on. Errors right at the start
+// fail as usual, so repetitions and blocks around the rule still end on their closing token, whether or not
+// it is one of stops. Rules that backtrack over a recovered failure forget its diagnostic.
+template <typename T>
+requires Exposable<T>
+struct Recover: public RuleModifiers<Recover<T>> {
+    T value;
+    StringStops stops;
+
+    using Result = FirstTuple<ExposeType<T>>;
+
+    ParserResult<std::optional<Result>> expose(Context &context) const {
+        size_t start = context.state.index;
+
+        auto result = value.expose(context);
+
+        if (auto pointer = result.ptr()) {
+            return ParserResult<std::optional<Result>> {
+                std::optional { getTupleFirst(std::move(*pointer)) }
+            };
+        }
+
+        auto error = result.error();
+        auto &state = context.state;
+
+        if (!state.diagnostics || !(error->matched || error->index > start)) {
+            return ParserResult<std::optional<Result>> { result.release() };
+        }
+
+        state.index = std::max(error->index, start);
+        context.pop(state.until(stops));
+
+        // Nothing skipped, recovering would let a repetition spin in place.
+        if (state.index == start) {
+            return ParserResult<std::optional<Result>> { result.release() };
+        }
+
+        state.diagnostics->push_back(std::move(*error));
+        state.recycle(result.release());
+
+        return ParserResult<std::optional<Result>> { std::nullopt };
+    }
+
+    FirstSet first() const {
+        return firstSet(value);
+    }
+
+    Recover(T &&value, const std::vector<std::string_view> &stops) : value(std::forward<T>(value)), stops(stops) { }
+};
+
 template <typename T>
 requires Exposable<T>
 struct Fails: public RuleModifiers<Fails<T>> {
@@ -453,6 +879,8 @@ struct Fails: public RuleModifiers<Fails<T>> {
             return context.error(ErrorProhibitsPattern { });
         }
 
+        context.state.recycle(result.release());
+
         return ParserResult<> { std::make_tuple() };
     }
 
@@ -472,10 +900,9 @@ struct MatchOn: public RuleModifiers<MatchOn<T, Check>> {
 
         if (auto error = result.error()) {
             if (error->matched || check.expose(context).ptr()) {
-                Error sub = std::move(*error);
-                sub.matched = true;
+                error->matched = true;
 
-                return Result { std::move(sub) };
+                return Result { result.release() };
             }
         }
 
@@ -492,14 +919,20 @@ struct Peek: public RuleModifiers<Peek<T>> {
 
     auto expose(Context &context) const {
         size_t start = context.state.index;
+        size_t recorded = context.state.recorded();
 
         auto result = value.expose(context);
 
         context.state.index = start;
+        context.state.forget(recorded);
 
         return result;
     }
 
+    FirstSet first() const {
+        return firstSet(value);
+    }
+
     explicit Peek(T &&value) : value(std::forward<T>(value)) { }
 };
 
@@ -517,19 +950,15 @@ struct Map: public RuleModifiers<Map<T, K>> {
     ParserResult<Result> expose(Context &context) const {
         auto result = value.expose(context);
 
-        struct {
-            const K &map;
-
-            ParserResult<Result> operator()(Error &error) {
-                return ParserResult<Result> { std::move(error) };
-            }
+        if (auto error = result.error()) {
+            return ParserResult<Result> { result.release() };
+        }
 
-            ParserResult<Result> operator()(typename decltype(result)::Type &v) {
-                return ParserResult<Result> { std::make_tuple(map(std::move(v))) };
-            }
-        } visitor { map };
+        return ParserResult<Result> { std::make_tuple(map(std::move(*result.ptr()))) };
+    }
 
-        return std::visit(visitor, result);
+    FirstSet first() const {
+        return firstSet(value);
     }
 
     explicit Map(T &&value, K &&map) : value(std::forward<T>(value)), map(std::forward<K>(map)) { }
@@ -546,19 +975,15 @@ struct MapInto: public RuleModifiers<MapInto<T, K>> {
     ParserResultFromTuple<Result> expose(Context &context) const {
         auto result = value.expose(context);
 
-        struct {
-            const K &map;
-
-            ParserResultFromTuple<Result> operator()(Error &error) {
-                return ParserResultFromTuple<Result> { std::move(error) };
-            }
+        if (auto error = result.error()) {
+            return ParserResultFromTuple<Result> { result.release() };
+        }
 
-            ParserResultFromTuple<Result> operator()(typename decltype(result)::Type &v) {
-                return ParserResultFromTuple<Result> { map(std::move(v)) }; // assuming map returns a tuple
-            }
-        } visitor { map };
+        return ParserResultFromTuple<Result> { map(std::move(*result.ptr())) }; // assuming map returns a tuple
+    }
 
-        return std::visit(visitor, result);
+    FirstSet first() const {
+        return firstSet(value);
     }
 
     explicit MapInto(T &&value, K &&map) : value(std::forward<T>(value)), map(std::forward<K>(map)) { }
@@ -575,25 +1000,52 @@ struct MapThrows: public RuleModifiers<MapInto<T, K>> {
     Result expose(Context &context) const {
         auto result = value.expose(context);
 
-        struct {
-            Context &context;
-            const K &map;
-
-            Result operator()(Error &error) {
-                return Result { std::move(error) };
-            }
+        if (auto error = result.error()) {
+            return Result { result.release() };
+        }
 
-            Result operator()(typename decltype(result)::Type &v) {
-                return map(context, std::move(v)); // assuming map returns a tuple
-            }
-        } visitor { context, map };
+        return map(context, std::move(*result.ptr())); // assuming map returns a tuple
+    }
 
-        return std::visit(visitor, result);
+    FirstSet first() const {
+        return firstSet(value);
     }
 
     explicit MapThrows(T &&value, K &&map) : value(std::forward<T>(value)), map(std::forward<K>(map)) { }
 };
 
+template <typename T, typename List>
+ParserResult<List> exposeMany(const T &value, Context &context, List list) {
+    size_t lastIndex = context.state.index;
+    size_t lastRecorded = context.state.recorded();
+
+    ExposeResultType<T> result = value.expose(context);
+    while (auto pointer = result.ptr()) {
+        list.push_back(getTupleFirst(std::move(*pointer)));
+        lastIndex = context.state.index;
+        lastRecorded = context.state.recorded();
+
+        result = value.expose(context);
+    }
+
+    // always, since only way to exit that loop is for an error to happen
+    context.state.index = lastIndex;
+    context.state.forget(lastRecorded);
+
+    auto error = result.error();
+    assert(error);
+
+    error->matched |= context.state.committed > lastIndex;
+
+    if (error->matched) {
+        return ParserResult<List> { result.release() };
+    }
+
+    context.state.recycle(result.release());
+
+    return ParserResult<List> { std::move(list) };
+}
+
 template <typename T>
 requires Exposable<T>
 struct Many: public RuleModifiers<Many<T>> {
@@ -602,42 +1054,315 @@ struct Many: public RuleModifiers<Many<T>> {
     using Result = FirstTuple<ExposeType<T>>;
 
     ParserResult<std::vector<Result>> expose(Context &context) const {
-        std::vector<Result> list;
+        return exposeMany(value, context, std::vector<Result> { });
+    }
 
-        size_t lastIndex = context.state.index;
+    FirstSet first() const {
+        auto result = firstSet(value);
+        result.nullable = true;
 
-        ExposeResultType<T> result = value.expose(context);
-        while (auto pointer = result.ptr()) {
-            list.push_back(getTupleFirst(std::move(*pointer)));
-            lastIndex = context.state.index;
+        return result;
+    }
 
-            result = value.expose(context);
-        }
+    explicit Many(T &&value) : value(std::forward<T>(value)) { }
+};
 
-        // always, since only way to exit that loop is for an error to happen
-        context.state.index = lastIndex;
+struct Repeat {
+    size_t min = 0;
+    size_t max = std::numeric_limits<size_t>::max();
 
-        auto error = result.error();
-        assert(error);
+    bool trailing = false; // a separator may follow the last item
 
-        if (error->matched) {
-            return ParserResult<std::vector<Result>> { std::move(*error) };
-        }
+    size_t reserve = 0; // capacity to start with, 0 to use the average of earlier results
+};
 
-        return ParserResult<std::vector<Result>> { std::move(list) };
+// Matches nothing, for bounded repetition without separators.
+struct NoSeparator: public RuleModifiers<NoSeparator> {
+    ParserResult<> expose(Context &) const { // NOLINT(readability-convert-member-functions-to-static)
+        return ParserResult<> { std::make_tuple() };
     }
 
-    explicit Many(T &&value) : value(std::forward<T>(value)) { }
+    FirstSet first() const { // NOLINT(readability-convert-member-functions-to-static)
+        return FirstSet::empty();
+    }
+};
+
+// Items separated by separator into one flat vector, between repeat.min and repeat.max of them.
+// Stops without trying another separator once max items are in. A separator not followed by an item
+// is left unconsumed unless repeat.trailing allows it.
+template <typename T, typename Separator>
+requires Exposable<T> && Exposable<Separator>
+struct SepBy: public RuleModifiers<SepBy<T, Separator>> {
+    T value;
+    Separator separator;
+
+    Repeat repeat;
+
+    // Eight times a running average of result sizes. Threads sharing the rule only need a rough hint, so relaxed is enough.
+    mutable std::atomic<size_t> average = 0;
+
+    constexpr static size_t maxReserve = 1 << 16;
+
+    using Result = FirstTuple<ExposeType<T>>;
+    using List = std::vector<Result>;
+
+    ParserResult<List> expose(Context &context) const {
+        List list;
+        list.reserve(std::min({ repeat.reserve ? repeat.reserve : average.load(std::memory_order_relaxed) / 8,
+            repeat.max, maxReserve }));
+
+        std::unique_ptr<Error> failure;
+
+        size_t index = context.state.index;
+        size_t recorded = context.state.recorded();
+
+        while (list.size() < repeat.max) {
+            if (!list.empty()) {
+                auto between = separator.expose(context);
+
+                if (auto error = between.error()) {
+                    error->matched |= context.state.committed > index;
+
+                    if (error->matched) {
+                        return ParserResult<List> { between.release() };
+                    }
+
+                    failure = between.release();
+                    break;
+                }
+
+                if (repeat.trailing) {
+                    index = context.state.index;
+                    recorded = context.state.recorded();
+                }
+            }
+
+            auto item = value.expose(context);
+
+            if (auto error = item.error()) {
+                error->matched |= context.state.committed > index;
+
+                if (error->matched) {
+                    return ParserResult<List> { item.release() };
+                }
+
+                failure = item.release();
+                break;
+            }
+
+            list.push_back(getTupleFirst(std::move(*item.ptr())));
+            index = context.state.index;
+            recorded = context.state.recorded();
+        }
+
+        context.state.index = index;
+        context.state.forget(recorded);
+
+        if (list.size() < repeat.min) {
+            return ParserResult<List> { std::move(failure) };
+        }
+
+        context.state.recycle(std::move(failure));
+
+        size_t previous = average.load(std::memory_order_relaxed);
+        average.store(previous ? previous - previous / 8 + list.size() : list.size() * 8, std::memory_order_relaxed);
+
+        return ParserResult<List> { std::move(list) };
+    }
+
+    FirstSet first() const {
+        auto result = firstSet(value);
+        result.nullable |= repeat.min == 0;
+
+        return result;
+    }
+
+    // Throws std::invalid_argument for repeat.min > repeat.max, no count of items could satisfy it.
+    SepBy(T &&value, Separator &&separator, const Repeat &repeat)
+        : value(std::forward<T>(value)), separator(std::forward<Separator>(separator)), repeat(repeat) {
+        if (repeat.min > repeat.max)
+            throw std::invalid_argument("Repeat needs min <= max.");
+    }
+
+    SepBy(const SepBy &other)
+        : value(other.value), separator(other.separator), repeat(other.repeat), average(other.average.load()) { }
+    SepBy(SepBy &&other) noexcept
+        : value(std::move(other.value)), separator(std::move(other.separator)), repeat(other.repeat),
+        average(other.average.load()) { }
+};
+
+template <typename Self>
+auto RuleModifiers<Self>::many(const Repeat &repeat) {
+    return SepBy<Self, NoSeparator> { self(), NoSeparator { }, repeat };
+}
+
+template <typename Self>
+template <typename Separator>
+auto RuleModifiers<Self>::sepBy(Separator &&separator, const Repeat &repeat) {
+    return SepBy<Self, Separator> { self(), std::forward<Separator>(separator), repeat };
+}
+
+template <typename Self>
+template <typename Separator>
+auto RuleModifiers<Self>::sepBy(Separator &&separator) {
+    return SepBy<Self, Separator> { self(), std::forward<Separator>(separator), Repeat { } };
+}
+
+// Exposes value back to back until the input ends, handing each result to callback. Nothing backtracks
+// over a finished item, so each one is released and chunked inputs only hold the item being parsed.
+template <typename T, typename Callback>
+requires Exposable<T>
+ParserResult<> exposeEach(const T &value, Context &context, Callback &&callback) {
+    while (context.state.ensure(context.state.index + 1)) {
+        size_t start = context.state.index;
+
+        auto result = value.expose(context);
+
+        if (auto error = result.error()) {
+            return ParserResult<> { result.release() };
+        }
+
+        // An item that consumes nothing would repeat forever.
+        if (context.state.index == start) {
+            return context.error<>(ErrorNoMatchingPattern { });
+        }
+
+        callback(getTupleFirst(std::move(*result.ptr())));
+
+        context.state.release(context.state.index);
+    }
+
+    return ParserResult<> { std::make_tuple() };
+}
+
+template <typename T>
+requires Exposable<T>
+struct ArenaMany: public RuleModifiers<ArenaMany<T>> {
+    T value;
+
+    using Result = FirstTuple<ExposeType<T>>;
+
+    ParserResult<std::pmr::vector<Result>> expose(Context &context) const {
+        return exposeMany(value, context, std::pmr::vector<Result>(context.resource()));
+    }
+
+    FirstSet first() const {
+        auto result = firstSet(value);
+        result.nullable = true;
+
+        return result;
+    }
+
+    explicit ArenaMany(T &&value) : value(std::forward<T>(value)) { }
+};
+
+// Destroys the value and hands its memory back to the resource, a no-op for monotonic arenas.
+template <typename T>
+struct ArenaDelete {
+    std::pmr::memory_resource *resource = nullptr;
+
+    void operator()(T *pointer) const {
+        std::pmr::polymorphic_allocator<T>(resource).delete_object(pointer);
+    }
+};
+
+template <typename T>
+using ArenaPtr = std::unique_ptr<T, ArenaDelete<T>>;
+
+template <typename T>
+requires Exposable<T>
+struct MakeArena: public RuleModifiers<MakeArena<T>> {
+    T value;
+
+    using Value = FirstTuple<ExposeType<T>>;
+
+    ParserResult<ArenaPtr<Value>> expose(Context &context) const {
+        auto result = value.expose(context);
+
+        if (auto error = result.error()) {
+            return ParserResult<ArenaPtr<Value>> { result.release() };
+        }
+
+        auto resource = context.resource();
+        auto pointer = std::pmr::polymorphic_allocator<Value>(resource).template new_object<Value>(
+            std::move(std::get<0>(*result.ptr()))
+        );
+
+        return ParserResult<ArenaPtr<Value>> { std::make_tuple(ArenaPtr<Value>(pointer, ArenaDelete<Value> { resource })) };
+    }
+
+    FirstSet first() const {
+        return firstSet(value);
+    }
+
+    explicit MakeArena(T &&value) : value(std::forward<T>(value)) { }
 };
 
+// Which alternatives of a Branch or Pick can start on each byte.
+template <size_t size>
+struct FirstDispatch {
+    FirstSet first;
+
+    std::bitset<size> all;
+    std::array<std::bitset<size>, 256> candidates;
+
+    std::array<std::string_view, size> literals;
+
+    // Keeps State::furthest complete for alternatives that were skipped instead of failing.
+    void skipped(size_t index, State &state) const {
+        if (!literals[index].empty() && state.index >= state.furthest)
+            state.fail(state.index, ErrorMustMatchText { literals[index] });
+    }
+
+    void add(size_t index, const FirstSet &set) {
+        first |= set;
+        literals[index] = set.literal;
+
+        for (size_t byte = 0; byte < candidates.size(); byte++) {
+            if (set.accepts(static_cast<uint8_t>(byte)))
+                candidates[byte].set(index);
+        }
+    }
+
+    [[nodiscard]]
+    const std::bitset<size> &at(State &state) const {
+        if (!state.ensure(state.index + 1))
+            return all;
+
+        return candidates[static_cast<uint8_t>(*state.data(state.index))];
+    }
+
+    template <typename ...Args>
+    explicit FirstDispatch(const std::tuple<Args...> &components) {
+        all.set();
+
+        size_t index = 0;
+
+        std::apply([this, &index](const auto &...component) {
+            (add(index++, firstSet(component)), ...);
+        }, components);
+    }
+};
+
+// Alternatives missing from candidates are skipped, except the last one so the error stays the same.
 template <bool self, size_t index, typename ...Args>
-auto anyOfTupleSized(const std::tuple<Args ...> &value, Context &context) {
+auto anyOfTupleSized(const std::tuple<Args ...> &value, Context &context, const FirstDispatch<sizeof...(Args)> &lookahead,
+    const std::bitset<sizeof...(Args)> &candidates) {
     using Type = std::conditional_t<self, FirstResultVariant<Args...>, ResultVariant<Args...>>;
 
     if constexpr (index >= std::tuple_size_v<std::tuple<Args ...>>) {
         return context.error<Type>(ErrorNoMatchingPattern());
     } else {
+        if constexpr (index + 1 < std::tuple_size_v<std::tuple<Args ...>>) {
+            if (!candidates.test(index)) {
+                lookahead.skipped(index, context.state);
+
+                return anyOfTupleSized<self, index + 1, Args...>(value, context, lookahead, candidates);
+            }
+        }
+
         size_t start = context.state.index;
+        size_t recorded = context.state.recorded();
 
         auto subContext = context.extend(nullptr, nullptr);
         subContext.matched = false;
@@ -659,28 +1384,43 @@ auto anyOfTupleSized(const std::tuple<Args ...> &value, Context &context) {
         }
 
         context.state.index = start;
+        context.state.forget(recorded);
 
         auto error = result.error();
         assert(error);
 
+        error->matched |= context.state.committed > start;
+
         if (index + 1 >= std::tuple_size_v<std::tuple<Args ...>> || error->matched) {
-            return ParserResult<Type> { std::move(*error) };
+            return ParserResult<Type> { result.release() };
         }
 
-        return anyOfTupleSized<self, index + 1, Args...>(value, context);
+        context.state.recycle(result.release());
+
+        return anyOfTupleSized<self, index + 1, Args...>(value, context, lookahead, candidates);
     }
 }
 
 template <size_t index, typename T, typename ...Args>
 requires (std::same_as<ExposeType<T>, ExposeType<Args>> && ...)
-auto anyOfTupleValued(const std::tuple<T, Args...> &value, Context &context) {
+auto anyOfTupleValued(const std::tuple<T, Args...> &value, Context &context, const FirstDispatch<sizeof...(Args) + 1> &lookahead,
+    const std::bitset<sizeof...(Args) + 1> &candidates) {
     using Type = ExposeType<T>;
     using ResultType = ExposeResultType<T>;
 
     if constexpr (index >= std::tuple_size_v<std::tuple<T, Args ...>>) {
-        return ResultType { context.rawError(ErrorNoMatchingPattern()) };
+        return ResultType { context.ownedError(ErrorNoMatchingPattern()) };
     } else {
+        if constexpr (index + 1 < std::tuple_size_v<std::tuple<T, Args ...>>) {
+            if (!candidates.test(index)) {
+                lookahead.skipped(index, context.state);
+
+                return anyOfTupleValued<index + 1, T, Args...>(value, context, lookahead, candidates);
+            }
+        }
+
         size_t start = context.state.index;
+        size_t recorded = context.state.recorded();
 
         auto subContext = context.extend(nullptr, nullptr);
         subContext.matched = false;
@@ -692,49 +1432,169 @@ auto anyOfTupleValued(const std::tuple<T, Args...> &value, Context &context) {
         }
 
         context.state.index = start;
+        context.state.forget(recorded);
 
         auto error = result.error();
         assert(error);
 
+        error->matched |= context.state.committed > start;
+
         if (index + 1 >= std::tuple_size_v<std::tuple<T, Args ...>> || error->matched) {
-            return ResultType { std::move(*error) };
+            return ResultType { result.release() };
         }
 
-        return anyOfTupleValued<index + 1, T, Args...>(value, context);
+        context.state.recycle(result.release());
+
+        return anyOfTupleValued<index + 1, T, Args...>(value, context, lookahead, candidates);
     }
 }
 
 template <typename ...Args>
 struct BranchSome: public RuleModifiers<BranchSome<Args...>> {
     std::tuple<Args...> components;
+    FirstDispatch<sizeof...(Args)> lookahead;
 
     auto expose(Context &context) const {
-        return anyOfTupleSized<false, 0>(components, context);
+        return anyOfTupleSized<false, 0>(components, context, lookahead, lookahead.at(context.state));
+    }
+
+    FirstSet first() const {
+        return lookahead.first;
     }
 
-    explicit BranchSome(Args && ...args) : components(std::make_tuple(std::forward<Args>(args)...)) { }
+    explicit BranchSome(Args && ...args)
+        : components(std::make_tuple(std::forward<Args>(args)...)), lookahead(components) { }
+
+    // The lookahead holds views into the components, rebuild it wherever they end up.
+    BranchSome(const BranchSome &other) : components(other.components), lookahead(components) { }
+    BranchSome(BranchSome &&other) noexcept : components(std::move(other.components)), lookahead(components) { }
 };
 
 template <typename ...Args>
 struct Branch: public RuleModifiers<Branch<Args...>> {
     std::tuple<Args...> components;
+    FirstDispatch<sizeof...(Args)> lookahead;
 
     auto expose(Context &context) const {
-        return anyOfTupleSized<true, 0>(components, context);
+        return anyOfTupleSized<true, 0>(components, context, lookahead, lookahead.at(context.state));
     }
 
-    explicit Branch(Args && ...args) : components(std::make_tuple(std::forward<Args>(args)...)) { }
+    FirstSet first() const {
+        return lookahead.first;
+    }
+
+    explicit Branch(Args && ...args)
+        : components(std::make_tuple(std::forward<Args>(args)...)), lookahead(components) { }
+
+    // The lookahead holds views into the components, rebuild it wherever they end up.
+    Branch(const Branch &other) : components(other.components), lookahead(components) { }
+    Branch(Branch &&other) noexcept : components(std::move(other.components)), lookahead(components) { }
 };
 
 template <typename ...Args>
 struct Pick: public RuleModifiers<Pick<Args...>> {
     std::tuple<Args...> components;
+    FirstDispatch<sizeof...(Args)> lookahead;
 
     auto expose(Context &context) const {
-        return anyOfTupleValued<0>(components, context);
+        return anyOfTupleValued<0>(components, context, lookahead, lookahead.at(context.state));
     }
 
-    explicit Pick(Args && ...args) : components(std::make_tuple(std::forward<Args>(args)...)) { }
+    FirstSet first() const {
+        return lookahead.first;
+    }
+
+    explicit Pick(Args && ...args)
+        : components(std::make_tuple(std::forward<Args>(args)...)), lookahead(components) { }
+
+    // The lookahead holds views into the components, rebuild it wherever they end up.
+    Pick(const Pick &other) : components(other.components), lookahead(components) { }
+    Pick(Pick &&other) noexcept : components(std::move(other.components)), lookahead(components) { }
+};
+
+struct Operator {
+    std::string text;
+    int precedence; // higher binds tighter
+
+    bool rightAssociative = false;
+    bool keyword = false; // must be followed by a token stop like Keyword, for word operators such as "and"
+};
+
+// Binary operator expressions over operand, folded as fold(op, left, right) by precedence climbing.
+// Each precedence level costs nothing unless the input uses it, where nesting Rule/Many levels pays for every one.
+// The longest operator matching the input wins. An operand missing after an operator is an error.
+template <typename T, typename Fold>
+requires Exposable<T>
+struct Operators: public RuleModifiers<Operators<T, Fold>> {
+    T operand;
+    Fold fold;
+
+    std::vector<Operator> operators; // longest text first
+    std::bitset<256> starts;
+
+    using Value = FirstTuple<ExposeType<T>>;
+
+    const Operator *match(Context &context) const {
+        if (!context.state.ensure(context.state.index + 1)
+            || !starts.test(static_cast<uint8_t>(*context.state.data(context.state.index))))
+            return nullptr;
+
+        for (const auto &op : operators) {
+            if (op.text == context.pull(op.text.size()) && (!op.keyword || context.ends(op.text.size())))
+                return &op;
+        }
+
+        return nullptr;
+    }
+
+    ParserResult<Value> climb(Context &context, int minimum) const {
+        auto left = operand.expose(context);
+
+        if (auto error = left.error()) {
+            return ParserResult<Value> { left.release() };
+        }
+
+        Value value = getTupleFirst(std::move(*left.ptr()));
+
+        while (auto op = match(context)) {
+            if (op->precedence < minimum)
+                break;
+
+            context.pop(op->text.size());
+
+            auto right = climb(context, op->rightAssociative ? op->precedence : op->precedence + 1);
+
+            if (auto error = right.error()) {
+                return ParserResult<Value> { right.release() };
+            }
+
+            value = fold(*op, std::move(value), std::move(std::get<0>(*right.ptr())));
+        }
+
+        return ParserResult<Value> { std::make_tuple(std::move(value)) };
+    }
+
+    ParserResult<Value> expose(Context &context) const {
+        return climb(context, std::numeric_limits<int>::min());
+    }
+
+    FirstSet first() const {
+        return firstSet(operand);
+    }
+
+    Operators(T &&operand, std::vector<Operator> table, Fold &&fold)
+        : operand(std::forward<T>(operand)), fold(std::forward<Fold>(fold)), operators(std::move(table)) {
+        std::erase_if(operators, [](const Operator &op) { return op.text.empty(); });
+
+        std::stable_sort(operators.begin(), operators.end(), [](const Operator &a, const Operator &b) {
+            return a.text.size() > b.text.size();
+        });
+
+        for (const auto &op : operators) {
+            if (!op.text.empty())
+                starts.set(static_cast<uint8_t>(op.text.front()));
+        }
+    }
 };
 
 template <typename T>
@@ -748,19 +1608,118 @@ struct Capture: public RuleModifiers<Capture<T>> {
         auto result = value.expose(view);
 
         if (auto error = result.error()) {
-            return ParserResult<std::string> { std::move(*error) };
+            return ParserResult<std::string> { result.release() };
         }
 
         auto end = view.state.index;
 
         return ParserResult<std::string> {
-            std::string(&view.state.text[start], &view.state.text[end])
+            std::string(view.state.data(start), view.state.data(end))
         };
     }
 
+    FirstSet first() const {
+        return firstSet(value);
+    }
+
     explicit Capture(T &&value) : value(std::forward<T>(value)) { }
 };
 
+template <typename T>
+requires Exposable<T>
+struct ArenaCapture: public RuleModifiers<ArenaCapture<T>> {
+    T value;
+
+    ParserResult<std::pmr::string> expose(Context &view) const {
+        auto start = view.state.index;
+
+        auto result = value.expose(view);
+
+        if (auto error = result.error()) {
+            return ParserResult<std::pmr::string> { result.release() };
+        }
+
+        auto end = view.state.index;
+
+        return ParserResult<std::pmr::string> {
+            std::pmr::string(view.state.data(start), view.state.data(end), view.resource())
+        };
+    }
+
+    FirstSet first() const {
+        return firstSet(value);
+    }
+
+    explicit ArenaCapture(T &&value) : value(std::forward<T>(value)) { }
+};
+
+template <typename T>
+requires Exposable<T>
+struct CaptureView: public RuleModifiers<CaptureView<T>> {
+    T value;
+
+    ParserResult<std::string_view> expose(Context &view) const {
+        auto start = view.state.index;
+
+        auto result = value.expose(view);
+
+        if (auto error = result.error()) {
+            return ParserResult<std::string_view> { result.release() };
+        }
+
+        auto end = view.state.index;
+
+        return ParserResult<std::string_view> {
+            std::string_view(view.state.data(start), end - start)
+        };
+    }
+
+    FirstSet first() const {
+        return firstSet(value);
+    }
+
+    explicit CaptureView(T &&value) : value(std::forward<T>(value)) { }
+};
+
+template <typename T>
+requires Exposable<T>
+struct Profile: public RuleModifiers<Profile<T>> {
+    ProfileCounters &counters;
+
+    T value;
+
+    using Type = ExposeResultType<T>;
+
+    Type expose(Context &context) const {
+        auto start = context.state.index;
+        auto begin = std::chrono::steady_clock::now();
+
+        auto result = value.expose(context);
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin);
+        auto end = context.state.index;
+
+        counters.calls.fetch_add(1, std::memory_order_relaxed);
+        counters.nanoseconds.fetch_add(elapsed.count(), std::memory_order_relaxed);
+
+        if (result.error()) {
+            counters.failures.fetch_add(1, std::memory_order_relaxed);
+            counters.backtracked.fetch_add(end > start ? end - start : 0, std::memory_order_relaxed);
+        } else {
+            counters.successes.fetch_add(1, std::memory_order_relaxed);
+            counters.consumed.fetch_add(end - start, std::memory_order_relaxed);
+        }
+
+        return result;
+    }
+
+    FirstSet first() const {
+        return firstSet(value);
+    }
+
+    Profile(ProfileCounters &counters, T &&value) : counters(counters), value(std::forward<T>(value)) { }
+};
+
 template <typename ...Produces>
 struct Wrap: public RuleModifiers<Wrap<Produces...>> {
     const AnyRule<Produces...> *rule;
@@ -769,6 +1728,11 @@ struct Wrap: public RuleModifiers<Wrap<Produces...>> {
         return rule->dispatch(context);
     }
 
+    // Every Wrap of the same AnyRule shares memo entries.
+    const void *identity() const {
+        return rule;
+    }
+
     explicit Wrap(const AnyRule<Produces...> *rule) : rule(rule) { }
 };
 
@@ -791,7 +1755,9 @@ struct Debug: public RuleModifiers<Debug<T>> {
         if (Error *error = val.error()) {
             const char *matchable = error->matched ? " matched" : "";
 
-            LineDetails details(std::string(context.state.text), error->index, false);
+            auto &state = context.state;
+
+            LineDetails details({ state.text, state.count - state.base }, state.lines(), error->index - state.base, false);
             std::cout << "### DEBUG: " << name << " failed on line " << details.lineNumber;
             std::cout << " with" << matchable << " error " << reasonText(error->reason) << "\n";
 
@@ -799,7 +1765,7 @@ struct Debug: public RuleModifiers<Debug<T>> {
             std::cout << " | " << details.marker << "\n";
 
             std::cout << " - Text Consumed (" << start << ", " << end << "): \n";
-            std::cout << std::string(context.state.text + start, context.state.text + end);
+            std::cout << std::string(context.state.data(start), context.state.data(end));
 
             std::cout << "\n";
         }
@@ -807,43 +1773,159 @@ struct Debug: public RuleModifiers<Debug<T>> {
         return val;
     }
 
+    FirstSet first() const {
+        return firstSet(value);
+    }
+
     explicit Debug(std::string name, T &&value) : name(std::move(name)), value(std::forward<T>(value)) { }
 };
 
-template <typename ...Args1, typename ...Args2>
-ParserResult<Args1..., Args2...> concat(ParserResult<Args1...> &&first, ParserResult<Args2...> &&second) {
-    if (auto error = first.error()) {
-        return ParserResult<Args1..., Args2...>(std::move(*error));
+// Whether values of a type may point into the input. MemoTable::edit stops reusing results holding views since
+// the edited input is another buffer, specialize this for types of your own that keep views.
+template <typename T>
+struct HoldsViews: std::false_type { };
+
+template <>
+struct HoldsViews<std::string_view>: std::true_type { };
+
+template <typename ...Args>
+struct HoldsViews<std::tuple<Args...>>: std::bool_constant<(HoldsViews<Args>::value || ...)> { };
+
+template <typename ...Args>
+struct HoldsViews<std::variant<Args...>>: std::bool_constant<(HoldsViews<Args>::value || ...)> { };
+
+template <typename A, typename B>
+struct HoldsViews<std::pair<A, B>>: std::bool_constant<HoldsViews<A>::value || HoldsViews<B>::value> { };
+
+template <typename T>
+struct HoldsViews<std::optional<T>>: HoldsViews<T> { };
+
+template <typename T, typename Allocator>
+struct HoldsViews<std::vector<T, Allocator>>: HoldsViews<T> { };
+
+template <typename T, size_t size>
+struct HoldsViews<std::array<T, size>>: HoldsViews<T> { };
+
+template <typename T>
+struct HoldsViews<std::unique_ptr<T>>: HoldsViews<T> { };
+
+template <typename T>
+struct HoldsViews<std::shared_ptr<T>>: HoldsViews<T> { };
+
+template <typename T>
+requires Exposable<T>
+struct Memo: public RuleModifiers<Memo<T>> {
+    T value;
+
+    using Type = ExposeResultType<T>;
+
+    static_assert(std::is_copy_constructible_v<typename Type::Type>,
+        "Memo keeps one result per position and hands out copies of it, memoize rules whose values are copyable.");
+
+    static Type copy(const Type &result) {
+        if (auto pointer = result.ptr()) {
+            return Type { typename Type::Type(*pointer) };
+        }
+
+        return Type { result.error()->clone() };
     }
 
-    if (auto error = second.error()) {
-        return ParserResult<Args1..., Args2...>(std::move(*error));
+    const void *identity() const {
+        if constexpr (requires { value.identity(); }) {
+            return value.identity();
+        } else {
+            return this;
+        }
     }
 
-    auto &&tuple1 = std::move(*first.ptr());
-    auto &&tuple2 = std::move(*second.ptr());
+    Type expose(Context &context) const {
+        MemoTable *table = context.state.memo;
 
-    return ParserResult<Args1..., Args2...> {
-        std::tuple_cat(std::move(tuple1), std::move(tuple2))
-    };
-}
+        if (!table) {
+            return value.expose(context);
+        }
+
+        MemoTable::Key key {
+            identity(), context.state.index, &context.space, &context.token, context.matched
+        };
 
-template <size_t index, typename ...Args>
-auto exposeTupleSized(const std::tuple<Args ...> &value, Context &view) {
-    using Tuple = std::tuple<Args ...>;
+        size_t start = context.state.index;
+
+        if (auto entry = table->find(key)) {
+            context.state.index = start + entry->end;
+            context.state.examined = std::max(context.state.examined, start + entry->reach);
+            context.state.anchors += entry->anchored;
+            context.matched = entry->matched;
+
+            auto result = copy(*static_cast<const Type *>(entry->value.get()));
+            size_t cut = entry->cut;
+
+            // The rule doesn't run again, so report its failure and make its commit as if it had.
+            if (auto error = result.error()) {
+                error->index = start + entry->failure;
+                context.state.fail(error->index, error->reason);
+            }
 
-    if constexpr (index >= std::tuple_size_v<Tuple>) {
-        return ParserResult<> { std::tuple<> { } };
+            // Last, committing may sweep the table and the entry with it.
+            if (cut != std::string_view::npos)
+                context.state.commit(start + cut);
+
+            return result;
+        }
+
+        // Track what this rule alone looks at, then fold it back into the enclosing rule's reach.
+        size_t examined = std::exchange(context.state.examined, start);
+        size_t anchors = context.state.anchors;
+        size_t committed = context.state.committed;
+
+        auto result = value.expose(context);
+
+        size_t reach = std::max(context.state.examined, context.state.index);
+        context.state.examined = std::max(examined, reach);
+
+        MemoTable::Entry entry {
+            context.state.index - start,
+            reach - start,
+            context.matched,
+            result.error() ? result.error()->index - start : 0,
+            { new Type(copy(result)), [](void *v) { delete static_cast<Type *>(v); } }
+        };
+
+        if (context.state.committed != committed)
+            entry.cut = context.state.committed - start;
+
+        entry.anchored = context.state.anchors != anchors;
+        entry.views = HoldsViews<typename Type::Type>::value;
+
+        table->insert(key, std::move(entry));
+
+        return result;
+    }
+
+    FirstSet first() const {
+        return firstSet(value);
+    }
+
+    explicit Memo(T &&value) : value(std::forward<T>(value)) { }
+};
+
+template <typename ...Args>
+using SequenceResult = ParserResultFromTuple<decltype(std::tuple_cat(std::declval<ExposeType<Args>>()...))>;
+
+// Each component's values stay in its own result on the stack until the last one matched,
+// then a single tuple_cat moves every value once into the sequence's result.
+template <size_t index, typename ...Args, typename ...Done>
+SequenceResult<Args...> exposeTupleSized(const std::tuple<Args ...> &value, Context &view, Done &...done) {
+    if constexpr (index >= sizeof...(Args)) {
+        return SequenceResult<Args...> { std::tuple_cat(std::move(done)...) };
     } else {
         auto result = expose(std::get<index>(value), view);
 
-        using Out = decltype(concat(std::move(result), exposeTupleSized<index + 1, Args...>(value, view)));
-
         if (auto error = result.error()) {
-            return Out { std::move(*error) };
+            return SequenceResult<Args...> { result.release() };
         }
 
-        return concat(std::move(result), exposeTupleSized<index + 1, Args...>(value, view));
+        return exposeTupleSized<index + 1>(value, view, done..., *result.ptr());
     }
 }
 
@@ -860,5 +1942,14 @@ struct Rule: public RuleModifiers<Rule<Args...>> {
         return exposeTuple(components, context);
     }
 
+    FirstSet first() const {
+        return std::apply([](const auto &...component) {
+            auto result = FirstSet::empty();
+            ((result = result.then(firstSet(component))), ...);
+
+            return result;
+        }, components);
+    }
+
     explicit Rule(Args && ...args) : components(std::make_tuple(std::forward<Args>(args)...)) { }
 };
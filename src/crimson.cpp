@@ -1,5 +1,13 @@
 #include <crimson/crimson.h>
 
+#include <map>
+#include <mutex>
+#include <iomanip>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
 std::string reasonSubtext(const ErrorMustMatchText &reason) {
     std::stringstream stream;
     stream << "Expected " << reason.text << " but got something else.";
@@ -34,49 +42,782 @@ std::string reasonSubtext(const ErrorMustEnd &) {
     return "Expected the end of the file but got more text.";
 }
 
+std::string reasonSubtext(const ErrorExpectedOneOf &reason) {
+    std::stringstream stream;
+    stream << "Expected one of ";
+
+    const auto &texts = *reason.texts;
+
+    for (size_t a = 0; a < texts.size(); a++) {
+        if (a > 0)
+            stream << (a + 1 == texts.size() ? " or " : ", ");
+
+        stream << texts[a];
+    }
+
+    stream << " but got something else.";
+
+    return stream.str();
+}
+
+std::string reasonSubtext(const ErrorExpectedNumber &) {
+    return "Expected a number here.";
+}
+
+std::string reasonSubtext(const ErrorNumberOutOfRange &reason) {
+    std::stringstream stream;
+    stream << "Number " << reason.text << " is out of range.";
+
+    return stream.str();
+}
+
 std::string reasonText(const ErrorReason &reason) {
     return std::visit([](const auto &value) {
         return reasonSubtext(value);
     }, reason);
 }
 
+Error Error::clone() const {
+    return Error { index, reason, matched };
+}
+
 Error::Error(size_t index, ErrorReason reason, bool matched)
     : index(index), reason(std::move(reason)), matched(matched) { }
 
-std::unordered_set<char> hardCharacters() {
-    return {
-        ':', ';', ',', '.', '{', '}', '+', '-',
-        '=', '/', '\\', '@', '#', '$', '%', '^',
-        '&', '|', '*', '(', ')', '!', '?', '<',
-        '>', '~', '[', ']', '\"', '\''
-    };
+bool FirstSet::accepts(uint8_t byte) const {
+    return !known || nullable || bytes.test(byte);
 }
 
-bool AnyHard::stop(std::string_view view, State &state) const {
-    auto value = view[0];
+FirstSet &FirstSet::operator|=(const FirstSet &other) {
+    bytes |= other.bytes;
+    nullable = nullable || other.nullable;
+    known = known && other.known;
+    literal = { };
 
-    return std::isspace(value) || stopAt.find(value) != stopAt.end();
+    return *this;
 }
 
-AnyHard::AnyHard() : stopAt(hardCharacters()) { }
-AnyHard::AnyHard(std::unordered_set<char> stopAt) : stopAt(std::move(stopAt)) { }
+FirstSet FirstSet::then(const FirstSet &next) const {
+    if (!known || !nullable)
+        return *this;
+
+    if (!next.known)
+        return unknown();
+
+    FirstSet result = next;
+    result.bytes |= bytes;
+    result.literal = { };
+
+    return result;
+}
+
+FirstSet FirstSet::unknown() {
+    FirstSet result;
+    result.known = false;
+
+    return result;
+}
+
+FirstSet FirstSet::empty() {
+    FirstSet result;
+    result.nullable = true;
+
+    return result;
+}
+
+FirstSet FirstSet::of(std::string_view text) {
+    if (text.empty())
+        return empty();
+
+    FirstSet result;
+    result.bytes.set(static_cast<uint8_t>(text[0]));
+    result.literal = text;
+
+    return result;
+}
+
+size_t Stoppable::span(std::string_view view, State &state) const {
+    size_t size = 0;
+
+    while (size < view.size() && !stop(view.substr(size), state)) {
+        size++;
+    }
+
+    return size;
+}
+
+size_t Stoppable::reach() const {
+    return 1;
+}
+
+namespace {
+    using ByteTable = std::array<bool, 256>;
+    using SpanFunction = size_t (*)(const ByteClass &byteClass, const char *data, size_t size);
+
+    size_t spanScalar(const ByteClass &byteClass, const char *data, size_t size) {
+        for (size_t a = 0; a < size; a++) {
+            if (byteClass.table[static_cast<uint8_t>(data[a])])
+                return a;
+        }
+
+        return size;
+    }
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    // SSE2 has no byte shuffle, so the 16 byte path needs SSSE3 for the nibble lookups.
+    __attribute__((target("ssse3")))
+    size_t spanSSSE3(const ByteClass &byteClass, const char *data, size_t size) {
+        auto low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(byteClass.low.data()));
+        auto high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(byteClass.high.data()));
+        auto nibble = _mm_set1_epi8(0x0F);
+        auto zero = _mm_setzero_si128();
+
+        size_t a = 0;
+
+        for (; a + 16 <= size; a += 16) {
+            auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + a));
+
+            auto lowBits = _mm_shuffle_epi8(low, _mm_and_si128(bytes, nibble));
+            auto highBits = _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble));
+
+            auto misses = _mm_cmpeq_epi8(_mm_and_si128(lowBits, highBits), zero);
+            auto hits = ~static_cast<uint32_t>(_mm_movemask_epi8(misses)) & 0xFFFFu;
+
+            if (hits)
+                return a + __builtin_ctz(hits);
+        }
+
+        return a + spanScalar(byteClass, data + a, size - a);
+    }
+
+    __attribute__((target("avx2")))
+    size_t spanAVX2(const ByteClass &byteClass, const char *data, size_t size) {
+        // vpshufb looks up within each 128-bit lane, so both lanes get a copy of the tables.
+        auto low = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(byteClass.low.data())));
+        auto high = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(byteClass.high.data())));
+        auto nibble = _mm256_set1_epi8(0x0F);
+        auto zero = _mm256_setzero_si256();
+
+        size_t a = 0;
 
-bool NotSpace::stop(std::string_view view, State &state) const {
-    return !std::isspace(view[0]);
+        for (; a + 32 <= size; a += 32) {
+            auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + a));
+
+            auto lowBits = _mm256_shuffle_epi8(low, _mm256_and_si256(bytes, nibble));
+            auto highBits = _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble));
+
+            auto misses = _mm256_cmpeq_epi8(_mm256_and_si256(lowBits, highBits), zero);
+            auto hits = ~static_cast<uint32_t>(_mm256_movemask_epi8(misses));
+
+            if (hits)
+                return a + __builtin_ctz(hits);
+        }
+
+        return a + spanSSSE3(byteClass, data + a, size - a);
+    }
+
+    SpanFunction selectSpan() {
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx2"))
+            return spanAVX2;
+
+        if (__builtin_cpu_supports("ssse3"))
+            return spanSSSE3;
+
+        return spanScalar;
+    }
+#else
+    SpanFunction selectSpan() {
+        return spanScalar;
+    }
+#endif
+
+    ByteTable spaceTable() {
+        ByteTable table { };
+
+        for (size_t a = 0; a < table.size(); a++) {
+            table[a] = std::isspace(static_cast<int>(a));
+        }
+
+        return table;
+    }
+
+    ByteTable hardTable(std::string_view characters) {
+        ByteTable table = spaceTable();
+
+        for (char c : characters) {
+            table[static_cast<uint8_t>(c)] = true;
+        }
+
+        return table;
+    }
+
+    const ByteClass &hardCharacters() {
+        static const ByteClass hard(hardTable(
+            ":;,.{}+-=/\\@#$%^&|*()!?<>~[]\"'"
+        ));
+
+        return hard;
+    }
+
+    ByteTable notSpaceTable() {
+        ByteTable table = spaceTable();
+
+        for (auto &value : table) {
+            value = !value;
+        }
+
+        return table;
+    }
 }
 
+bool ByteClass::stop(std::string_view view, State &) const {
+    return table[static_cast<uint8_t>(view[0])];
+}
+
+size_t ByteClass::span(std::string_view view, State &) const {
+    // Spans are often empty (no space to skip), worth checking before touching vector registers.
+    if (table[static_cast<uint8_t>(view[0])])
+        return 0;
+
+    if (!vectorized)
+        return spanScalar(*this, view.data(), view.size());
+
+    static const SpanFunction spanVectorized = selectSpan();
+
+    return spanVectorized(*this, view.data(), view.size());
+}
+
+ByteClass::ByteClass(const std::array<bool, 256> &table) : table(table) {
+    std::array<uint16_t, 16> rows { };
+
+    for (size_t a = 0; a < table.size(); a++) {
+        if (table[a])
+            rows[a >> 4] |= static_cast<uint16_t>(1u << (a & 0xF));
+    }
+
+    std::vector<uint16_t> distinct;
+
+    for (size_t h = 0; h < rows.size(); h++) {
+        if (!rows[h])
+            continue;
+
+        auto match = std::find(distinct.begin(), distinct.end(), rows[h]);
+        auto bit = static_cast<size_t>(match - distinct.begin());
+
+        if (match == distinct.end()) {
+            if (distinct.size() >= 8)
+                return;
+
+            distinct.push_back(rows[h]);
+        }
+
+        high[h] = static_cast<uint8_t>(1u << bit);
+    }
+
+    for (size_t bit = 0; bit < distinct.size(); bit++) {
+        for (size_t l = 0; l < low.size(); l++) {
+            if (distinct[bit] & (1u << l))
+                low[l] |= static_cast<uint8_t>(1u << bit);
+        }
+    }
+
+    vectorized = true;
+}
+
+AnyHard::AnyHard() : ByteClass(hardCharacters()) { }
+
+AnyHard::AnyHard(const std::unordered_set<char> &stopAt)
+    : ByteClass(hardTable(std::string(stopAt.begin(), stopAt.end()))) { }
+
+NotSpace::NotSpace() : ByteClass(notSpaceTable()) { }
+
 bool StringStops::stop(std::string_view view, State &state) const {
-    return std::any_of(stops.begin(), stops.end(), [view](auto stop) {
-        return stop.size() <= view.size() && view.substr(0, stop.size()) == stop;
+    if (stopsEmpty)
+        return true;
+
+    if (view.empty())
+        return false;
+
+    auto byte = static_cast<uint8_t>(view[0]);
+
+    return std::any_of(stops.begin() + offsets[byte], stops.begin() + offsets[byte + 1], [view](auto stop) {
+        return view.starts_with(stop);
     });
 }
 
-StringStops::StringStops(const std::vector<std::string_view> &stops) : stops(stops) { }
+size_t StringStops::reach() const {
+    size_t result = 1;
 
-void State::push(const Stoppable &stoppable) {
-    while (index < count && !stoppable.stop({ &text[index], count - index }, *this)) {
-        index++;
+    for (auto stop : stops) {
+        result = std::max(result, stop.size());
     }
+
+    return result;
+}
+
+size_t StringStops::span(std::string_view view, State &state) const {
+    if (stopsEmpty)
+        return 0;
+
+    size_t size = 0;
+
+    while (size < view.size()) {
+        size += first.span(view.substr(size), state);
+
+        if (size >= view.size() || stop(view.substr(size), state))
+            break;
+
+        size++;
+    }
+
+    return size;
+}
+
+namespace {
+    std::array<bool, 256> firstBytes(const std::vector<std::string_view> &stops) {
+        std::array<bool, 256> table { };
+
+        for (auto stop : stops) {
+            if (!stop.empty())
+                table[static_cast<uint8_t>(stop[0])] = true;
+        }
+
+        return table;
+    }
+}
+
+StringStops::StringStops(const std::vector<std::string_view> &stops) : first(firstBytes(stops)) {
+    for (auto stop : stops) {
+        if (stop.empty())
+            stopsEmpty = true;
+        else
+            this->stops.push_back(stop);
+    }
+
+    std::stable_sort(this->stops.begin(), this->stops.end(), [](auto a, auto b) {
+        return static_cast<uint8_t>(a[0]) < static_cast<uint8_t>(b[0]);
+    });
+
+    for (auto stop : this->stops) {
+        offsets[static_cast<uint8_t>(stop[0]) + 1]++;
+    }
+
+    for (size_t a = 1; a < offsets.size(); a++) {
+        offsets[a] += offsets[a - 1];
+    }
+}
+
+int32_t LiteralTrie::deepest(std::string_view view) const {
+    int32_t found = -1;
+    uint32_t node = 0;
+
+    for (char c : view) {
+        const auto &current = nodes[node];
+
+        auto begin = edges.begin() + current.edges;
+        auto end = begin + current.count;
+
+        auto edge = std::lower_bound(begin, end, static_cast<uint8_t>(c), [](const Edge &edge, uint8_t byte) {
+            return edge.byte < byte;
+        });
+
+        if (edge == end || edge->byte != static_cast<uint8_t>(c))
+            break;
+
+        node = edge->node;
+
+        if (nodes[node].value >= 0)
+            found = static_cast<int32_t>(node);
+    }
+
+    return found;
+}
+
+LiteralTrie::LiteralTrie(const std::vector<std::string> &literals) {
+    std::vector<std::map<uint8_t, uint32_t>> children(1);
+    std::vector<Node> built(1);
+
+    for (size_t a = 0; a < literals.size(); a++) {
+        const auto &literal = literals[a];
+
+        if (literal.empty())
+            continue;
+
+        uint32_t node = 0;
+
+        for (char c : literal) {
+            auto [iterator, inserted] = children[node].try_emplace(static_cast<uint8_t>(c), built.size());
+
+            if (inserted) {
+                Node child;
+                child.depth = built[node].depth + 1;
+
+                built.push_back(child);
+                children.emplace_back();
+            }
+
+            node = iterator->second;
+        }
+
+        if (built[node].value < 0)
+            built[node].value = static_cast<int32_t>(a);
+
+        longest = std::max(longest, literal.size());
+    }
+
+    // Children are always created after their parent, so one pass in order sees every parent first.
+    for (uint32_t node = 0; node < built.size(); node++) {
+        built[node].edges = static_cast<uint32_t>(edges.size());
+        built[node].count = static_cast<uint32_t>(children[node].size());
+
+        for (auto [byte, child] : children[node]) {
+            edges.push_back({ byte, child });
+
+            built[child].shorter = built[node].value >= 0 ? static_cast<int32_t>(node) : built[node].shorter;
+        }
+    }
+
+    nodes = std::move(built);
+}
+
+size_t MemoTable::KeyHash::operator()(const Key &key) const {
+    size_t hash = std::hash<const void *>()(key.rule);
+
+    auto combine = [&hash](size_t value) {
+        hash ^= value + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+    };
+
+    combine(key.index);
+    combine(std::hash<const void *>()(key.space));
+    combine(std::hash<const void *>()(key.token));
+    combine(key.matched);
+
+    return hash;
+}
+
+const MemoTable::Entry *MemoTable::find(const Key &key) const {
+    // Committed over, whether or not the sweep has come by yet.
+    if (key.index < floor)
+        return nullptr;
+
+    if (segments.empty()) {
+        auto iterator = entries.find(key);
+
+        return iterator == entries.end() ? nullptr : &iterator->second;
+    }
+
+    const auto &run = segment(key.index);
+
+    Key stored = key;
+    stored.index = key.index - run.start + run.stored;
+
+    auto iterator = entries.find(stored);
+
+    if (iterator == entries.end())
+        return nullptr;
+
+    return valid(iterator->second, run, key.index) ? &iterator->second : nullptr;
+}
+
+bool MemoTable::valid(const Entry &entry, const Segment &run, size_t index) const {
+    // Cached since the last edit, or everything it looked at is still in one piece.
+    bool fits = entry.edits == edits || (entry.contained && run.end - index >= entry.reach);
+
+    if (entry.views)
+        return entry.edits == edits;
+
+    if (entry.anchored)
+        return fits && entry.shift == run.start - run.stored;
+
+    return fits;
+}
+
+void MemoTable::insert(const Key &key, Entry entry) {
+    if (entries.size() >= capacity) {
+        compact();
+    }
+
+    if (entries.size() >= capacity) {
+        // Parsing mostly moves forward, so the earliest positions are the least likely to be hit again.
+        // Evicting down to half the capacity at once spreads the cost of the pass over the inserts that refill it.
+        std::vector<size_t> indices;
+        indices.reserve(entries.size());
+
+        for (const auto &pair : entries)
+            indices.push_back(pair.first.index);
+
+        auto kept = indices.end() - static_cast<std::ptrdiff_t>(capacity / 2);
+        std::nth_element(indices.begin(), kept, indices.end());
+
+        size_t threshold = kept == indices.end() ? std::numeric_limits<size_t>::max() : *kept;
+
+        std::erase_if(entries, [threshold](const auto &pair) { return pair.first.index < threshold; });
+
+        // Too many entries share the threshold's index to keep them all.
+        if (entries.size() >= capacity)
+            entries.clear();
+    }
+
+    Key stored = key;
+
+    if (!segments.empty()) {
+        const auto &run = segment(key.index);
+
+        stored.index = key.index - run.start + run.stored;
+        entry.shift = run.start - run.stored;
+        entry.contained = run.end - key.index >= entry.reach;
+    }
+
+    entry.edits = edits;
+
+    entries.insert_or_assign(stored, std::move(entry));
+}
+
+void MemoTable::clear() {
+    entries.clear();
+    segments.clear();
+
+    fresh = freshStart;
+
+    floor = 0;
+    sweep = 1024;
+}
+
+void MemoTable::discard(size_t before) {
+    floor = std::max(floor, before);
+
+    if (entries.size() < sweep)
+        return;
+
+    compact();
+
+    std::erase_if(entries, [this](const auto &pair) { return pair.first.index < floor; });
+
+    sweep = std::max<size_t>(entries.size() * 2, 1024);
+}
+
+void MemoTable::edit(size_t start, size_t removed, size_t inserted) {
+    constexpr size_t open = std::numeric_limits<size_t>::max();
+
+    if (segments.empty())
+        segments.push_back(Segment { 0, open, 0 });
+
+    std::vector<Segment> next;
+    next.reserve(segments.size() + 2);
+
+    auto add = [&next](Segment run) {
+        if (run.start >= run.end)
+            return;
+
+        // Bytes that are next to each other again, as when an insertion is deleted.
+        if (!next.empty() && next.back().end == run.start && next.back().stored + (run.start - next.back().start) == run.stored) {
+            next.back().end = run.end;
+            return;
+        }
+
+        next.push_back(run);
+    };
+
+    for (const auto &run : segments) {
+        if (run.start < start)
+            add(Segment { run.start, std::min(run.end, start), run.stored });
+    }
+
+    add(Segment { start, start + inserted, fresh });
+    fresh += inserted;
+
+    for (const auto &run : segments) {
+        if (run.end > start + removed) {
+            size_t from = std::max(run.start, start + removed);
+
+            add(Segment {
+                from - removed + inserted,
+                run.end == open ? open : run.end - removed + inserted,
+                run.stored + (from - run.start)
+            });
+        }
+    }
+
+    segments = std::move(next);
+    edits++;
+
+    // The next parse starts over from the beginning, cuts from the last one no longer apply.
+    floor = 0;
+
+    if (segments.size() > maxSegments)
+        compact();
+}
+
+void MemoTable::compact() {
+    if (segments.empty())
+        return;
+
+    // By stored position, to find where each entry is now.
+    std::vector<Segment> byStored = segments;
+    std::sort(byStored.begin(), byStored.end(), [](const Segment &a, const Segment &b) { return a.stored < b.stored; });
+
+    std::unordered_map<Key, Entry, KeyHash> kept;
+    kept.reserve(entries.size());
+
+    for (auto &[key, entry] : entries) {
+        auto after = std::upper_bound(byStored.begin(), byStored.end(), key.index,
+            [](size_t at, const Segment &run) { return at < run.stored; });
+
+        if (after == byStored.begin())
+            continue;
+
+        const auto &run = *(after - 1);
+
+        // Its bytes were replaced.
+        if (key.index - run.stored >= run.end - run.start)
+            continue;
+
+        Key moved = key;
+        moved.index = key.index - run.stored + run.start;
+
+        if (!valid(entry, run, moved.index))
+            continue;
+
+        entry.shift = 0;
+        entry.contained = true;
+
+        kept.insert_or_assign(moved, std::move(entry));
+    }
+
+    entries = std::move(kept);
+    segments.clear();
+
+    fresh = freshStart;
+}
+
+const MemoTable::Segment &MemoTable::segment(size_t index) const {
+    auto after = std::upper_bound(segments.begin(), segments.end(), index,
+        [](size_t at, const Segment &run) { return at < run.start; });
+
+    return *(after - 1);
+}
+
+MemoTable::MemoTable(size_t capacity) : capacity(capacity) { }
+
+Symbol SymbolTable::intern(std::string_view text) {
+    auto found = ids.find(text);
+
+    if (found != ids.end())
+        return found->second;
+
+    auto symbol = static_cast<Symbol>(texts.size());
+
+    ids.emplace(texts.emplace_back(text), symbol);
+
+    return symbol;
+}
+
+std::string_view SymbolTable::resolve(Symbol symbol) const {
+    return texts[symbol];
+}
+
+size_t SymbolTable::size() const {
+    return texts.size();
+}
+
+Symbol SharedSymbolTable::intern(std::string_view text) {
+    {
+        std::shared_lock lock(mutex);
+
+        auto found = ids.find(text);
+
+        if (found != ids.end())
+            return found->second;
+    }
+
+    // Another thread may have added it between the locks, the base class looks again.
+    std::unique_lock lock(mutex);
+
+    return SymbolTable::intern(text);
+}
+
+std::string_view SharedSymbolTable::resolve(Symbol symbol) const {
+    std::shared_lock lock(mutex);
+
+    return SymbolTable::resolve(symbol);
+}
+
+size_t SharedSymbolTable::size() const {
+    std::shared_lock lock(mutex);
+
+    return SymbolTable::size();
+}
+
+namespace {
+    struct ProfileRegistry {
+        std::mutex mutex;
+        std::deque<ProfileCounters> counters;
+    };
+
+    ProfileRegistry &profileRegistry() {
+        static ProfileRegistry registry;
+
+        return registry;
+    }
+}
+
+ProfileCounters &ProfileCounters::get(std::string_view name) {
+    auto &registry = profileRegistry();
+    std::lock_guard lock(registry.mutex);
+
+    for (auto &counters : registry.counters) {
+        if (counters.name == name)
+            return counters;
+    }
+
+    return registry.counters.emplace_back(std::string(name));
+}
+
+void ProfileCounters::report(std::ostream &out) {
+    auto &registry = profileRegistry();
+    std::lock_guard lock(registry.mutex);
+
+    std::vector<const ProfileCounters *> sorted;
+
+    for (const auto &counters : registry.counters)
+        sorted.push_back(&counters);
+
+    std::sort(sorted.begin(), sorted.end(), [](auto a, auto b) { return a->nanoseconds > b->nanoseconds; });
+
+    out << std::left << std::setw(24) << "rule" << std::right
+        << std::setw(12) << "calls" << std::setw(12) << "successes" << std::setw(12) << "failures"
+        << std::setw(14) << "consumed" << std::setw(14) << "backtracked" << std::setw(12) << "ms" << "\n";
+
+    for (auto counters : sorted) {
+        out << std::left << std::setw(24) << counters->name << std::right
+            << std::setw(12) << counters->calls << std::setw(12) << counters->successes
+            << std::setw(12) << counters->failures << std::setw(14) << counters->consumed
+            << std::setw(14) << counters->backtracked
+            << std::setw(12) << std::fixed << std::setprecision(3) << static_cast<double>(counters->nanoseconds) / 1e6
+            << "\n";
+    }
+}
+
+void ProfileCounters::reset() {
+    auto &registry = profileRegistry();
+    std::lock_guard lock(registry.mutex);
+
+    for (auto &counters : registry.counters) {
+        counters.calls = 0;
+        counters.successes = 0;
+        counters.failures = 0;
+        counters.consumed = 0;
+        counters.backtracked = 0;
+        counters.nanoseconds = 0;
+    }
+}
+
+ProfileCounters::ProfileCounters(std::string name) : name(std::move(name)) { }
+
+void State::push(const Stoppable &stoppable) {
+    index += until(stoppable);
 }
 
 void State::pop(size_t size, const Stoppable &stoppable) {
@@ -85,26 +826,127 @@ void State::pop(size_t size, const Stoppable &stoppable) {
     push(stoppable);
 }
 
-std::string_view State::pull(size_t size) const {
-    return { &text[index], std::min(size, count - index) };
+std::string_view State::pull(size_t size) {
+    ensure(index + size);
+
+    return { data(index), std::min(size, count - index) };
 }
 
 size_t State::until(const Stoppable &stoppable) {
-    size_t size = 0;
+    return scan(index, stoppable.reach(), [this, &stoppable](std::string_view view) {
+        return stoppable.span(view, *this);
+    });
+}
 
-    while ((index + size) < count) {
-        if (stoppable.stop({ &text[index + size], count - index - size }, *this)) {
-            break;
-        }
+bool State::ends(size_t size, const Stoppable &stoppable) {
+    ensure(index + size + stoppable.reach());
 
-        size++;
+    return (index + size >= count) || stoppable.stop({ data(index + size), count - index - size }, *this);
+}
+
+void State::release(size_t at) {
+    released = std::max(released, std::min(at, index));
+}
+
+void State::commit(size_t at) {
+    committed = std::max(committed, at);
+
+    release(at);
+
+    if (memo)
+        memo->discard(committed);
+}
+
+void State::fail(size_t at, const ErrorReason &given) {
+    if (at < furthest)
+        return;
+
+    if (at > furthest || !reason) {
+        furthest = at;
+        reason = given;
+        expected.clear();
     }
 
-    return size;
+    auto record = [this](std::string_view text) {
+        // Rules hand out views of their own literal, so a repeat of the last one is caught without comparing bytes.
+        if (expected.size() >= maxExpected || (!expected.empty() && expected.back().data() == text.data()))
+            return;
+
+        expected.push_back(text);
+    };
+
+    if (auto text = std::get_if<ErrorMustMatchText>(&given)) {
+        record(text->text);
+    } else if (auto set = std::get_if<ErrorExpectedOneOf>(&given)) {
+        for (auto text : *set->texts)
+            record(text);
+    }
 }
 
-bool State::ends(size_t size, const Stoppable &stoppable) {
-    return (index + size >= count) || stoppable.stop({ &text[index + size], count - index - size }, *this);
+Error State::failure() const {
+    if (!reason)
+        return Error { furthest, ErrorNoMatchingPattern { }, false };
+
+    std::vector<std::string_view> texts;
+
+    for (auto text : expected) {
+        if (std::find(texts.begin(), texts.end(), text) == texts.end())
+            texts.push_back(text);
+    }
+
+    if (texts.size() <= 1)
+        return Error { furthest, *reason, false };
+
+    return Error { furthest, ErrorExpectedOneOf { std::make_shared<const std::vector<std::string_view>>(std::move(texts)) }, false };
+}
+
+void State::report(Error &error) const {
+    if (reason && furthest >= error.index)
+        error = failure();
+}
+
+std::unique_ptr<Error> State::raise(size_t at, ErrorReason reason, bool matched) {
+    if (spare.empty())
+        return std::make_unique<Error>(at, std::move(reason), matched);
+
+    auto error = std::move(spare.back());
+    spare.pop_back();
+
+    error->index = at;
+    error->reason = std::move(reason);
+    error->matched = matched;
+
+    return error;
+}
+
+const LineIndex &State::lines() {
+    // Bytes at an index never change, so a window with the same start and size has the same lines.
+    if (!lineIndex || (input && (lineBase != base || lineIndex->size != count - base))) {
+        lineIndex = std::make_shared<LineIndex>(std::string_view(text, count - base));
+        lineBase = base;
+    }
+
+    return *lineIndex;
+}
+
+void State::reset(std::string_view view) {
+    text = view.data();
+    index = 0;
+    count = view.size();
+
+    base = 0;
+    input = nullptr;
+    released = 0;
+
+    furthest = 0;
+    reason.reset();
+    expected.clear();
+
+    lineIndex.reset();
+
+    examined = 0;
+    anchors = 0;
+    committed = 0;
 }
 
 State::State(std::string_view view) : text(view.data()), index(0), count(view.size()) { }
@@ -125,7 +967,11 @@ std::string_view Context::pull(size_t size) const { return state.pull(size); }
 
 bool Context::ends(size_t size) { return state.ends(size, token); }
 
+std::pmr::memory_resource *Context::resource() const { return state.resource; }
+
 Error Context::rawError(ErrorReason reason) const {
+    state.fail(state.index, reason);
+
     return Error {
         state.index,
         std::move(reason),
@@ -133,41 +979,81 @@ Error Context::rawError(ErrorReason reason) const {
     };
 }
 
+std::unique_ptr<Error> Context::ownedError(ErrorReason reason) const {
+    state.fail(state.index, reason);
+
+    return state.raise(state.index, std::move(reason), matched);
+}
+
 Context::Context(State &state, const Stoppable &space, const Stoppable &token)
     : state(state), space(space), token(token) { }
 
-LineDetails::LineDetails(const std::string &text, size_t index, bool backtrack) {
-    size_t lineIndex = index;
+namespace {
+    template <typename Callback>
+    void forNewlines(std::string_view text, Callback &&callback) {
+        size_t a = 0;
+
+#if defined(__SSE2__)
+        auto newline = _mm_set1_epi8('\n');
+
+        for (; a + 16 <= text.size(); a += 16) {
+            auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text.data() + a));
+            auto hits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)));
+
+            while (hits) {
+                callback(a + __builtin_ctz(hits));
+
+                hits &= hits - 1;
+            }
+        }
+#endif
+
+        for (; a < text.size(); a++) {
+            if (text[a] == '\n')
+                callback(a);
+        }
+    }
+}
+
+LinePosition LineIndex::locate(size_t index) const {
+    auto next = std::upper_bound(starts.begin(), starts.end(), index);
+    auto line = static_cast<size_t>(next - starts.begin()) - 1;
+
+    LinePosition position;
+    position.line = line + 1;
+    position.start = starts[line];
+    position.end = next == starts.end() ? size : *next - 1;
+    position.column = index - position.start;
+
+    return position;
+}
+
+LineIndex::LineIndex(std::string_view text) : size(text.size()) {
+    starts.push_back(0);
+
+    forNewlines(text, [this](size_t index) {
+        starts.push_back(index + 1);
+    });
+}
+
+LineDetails::LineDetails(std::string_view text, const LineIndex &lines, size_t index, bool backtrack) {
+    size_t lineIndex = std::min(index, text.size());
 
     if (backtrack) {
         if (lineIndex > 0)
             lineIndex--;
 
-        while (lineIndex == text.size() || (lineIndex > 0 && std::isspace(text[lineIndex])))
+        while (lineIndex > 0 && (lineIndex >= text.size() || std::isspace(text[lineIndex])))
             lineIndex--;
     }
 
-    // This is potentially slow.
-    // There's an evil bug somewhere here, in weird cases lineStart > lineEnd, going to push temp fix to State
-    auto lineStart = static_cast<int64_t>(text.rfind('\n', lineIndex));
-    if (lineStart == std::string::npos) {
-        lineStart = 0;
-    } else {
-        lineStart++;
-    }
-
-    auto lineEnd = text.find('\n', lineIndex);
-    if (lineEnd == std::string::npos) {
-        lineEnd = text.size();
-    }
-
-    line = text.substr(lineStart, lineEnd - lineStart);
+    auto position = lines.locate(lineIndex);
 
-    auto linePos = lineIndex - lineStart;
+    line = text.substr(position.start, position.end - position.start);
 
     std::stringstream markerStream;
 
-    for (size_t a = 0; a < linePos; a++) {
+    for (size_t a = 0; a < position.column && a < line.size(); a++) {
         if (std::isspace(line[a]))
             markerStream << line[a];
         else
@@ -177,9 +1063,12 @@ LineDetails::LineDetails(const std::string &text, size_t index, bool backtrack)
 
     marker = markerStream.str();
 
-    lineNumber = std::count(text.begin(), text.begin() + lineStart, '\n') + 1;
+    lineNumber = position.line;
 }
 
+LineDetails::LineDetails(const std::string &text, size_t index, bool backtrack)
+    : LineDetails(text, LineIndex(text), index, backtrack) { }
+
 std::monostate getTupleFirst(std::tuple<> &&) {
     return std::monostate { };
 }
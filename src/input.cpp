@@ -0,0 +1,159 @@
+#include <crimson/input.h>
+
+#include <cerrno>
+#include <cstring>
+#include <utility>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+std::string_view MappedFile::view() const {
+    return { address, size };
+}
+
+MappedFile::MappedFile(const std::string &path) {
+    int descriptor = open(path.c_str(), O_RDONLY);
+
+    if (descriptor < 0)
+        throw std::system_error(errno, std::generic_category(), path);
+
+    struct stat details { };
+
+    if (fstat(descriptor, &details) < 0) {
+        int error = errno;
+        close(descriptor);
+
+        throw std::system_error(error, std::generic_category(), path);
+    }
+
+    size = static_cast<size_t>(details.st_size);
+
+    // mmap refuses empty mappings, an empty view does the same job.
+    if (size > 0) {
+        void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+
+        if (mapped == MAP_FAILED) {
+            int error = errno;
+            close(descriptor);
+
+            throw std::system_error(error, std::generic_category(), path);
+        }
+
+        madvise(mapped, size, MADV_SEQUENTIAL);
+
+        address = static_cast<const char *>(mapped);
+    }
+
+    close(descriptor);
+}
+
+MappedFile::~MappedFile() {
+    if (address)
+        munmap(const_cast<char *>(address), size);
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : address(std::exchange(other.address, nullptr)), size(std::exchange(other.size, 0)) { }
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        if (address)
+            munmap(const_cast<char *>(address), size);
+
+        address = std::exchange(other.address, nullptr);
+        size = std::exchange(other.size, 0);
+    }
+
+    return *this;
+}
+
+size_t FileSource::read(char *data, size_t size) {
+    while (true) {
+        auto result = ::read(descriptor, data, size);
+
+        if (result >= 0)
+            return static_cast<size_t>(result);
+
+        if (errno != EINTR)
+            throw std::system_error(errno, std::generic_category(), "read");
+    }
+}
+
+FileSource::FileSource(const std::string &path) : descriptor(open(path.c_str(), O_RDONLY)), owned(true) {
+    if (descriptor < 0)
+        throw std::system_error(errno, std::generic_category(), path);
+
+    posix_fadvise(descriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+FileSource::FileSource(int descriptor, bool owned) : descriptor(descriptor), owned(owned) { }
+
+FileSource::~FileSource() {
+    if (owned && descriptor >= 0)
+        close(descriptor);
+}
+
+bool ChunkedInput::fill(State &state, size_t end) {
+    std::erase_if(retired, [this, &state](const Retired &old) {
+        if (old.end > state.released)
+            return false;
+
+        retiredSize -= old.buffer.size();
+
+        return true;
+    });
+
+    while (state.count < end && !exhausted) {
+        if (loaded >= buffer.size()) {
+            // Only the unreleased tail moves to the new buffer, the old one stays alive for views into it.
+            size_t keep = state.count - std::max(state.released, state.base);
+
+            if (retiredSize + keep >= limit)
+                throw std::length_error("ChunkedInput needs more than its limit buffered, release input as it is parsed.");
+
+            std::vector<char> next(std::min(limit - retiredSize, std::max(keep * 2, keep + chunk)));
+
+            if (keep > 0) {
+                std::memcpy(next.data(), buffer.data() + (loaded - keep), keep);
+
+                retiredSize += buffer.size();
+                retired.push_back(Retired { std::move(buffer), state.count });
+            }
+
+            buffer = std::move(next);
+            loaded = keep;
+
+            state.base = state.count - keep;
+        }
+
+        auto size = source.read(buffer.data() + loaded, std::min(chunk, buffer.size() - loaded));
+
+        if (size == 0)
+            exhausted = true;
+
+        loaded += size;
+
+        state.text = buffer.data();
+        state.count = state.base + loaded;
+    }
+
+    return end <= state.count;
+}
+
+ChunkedInput::ChunkedInput(Source &source, size_t chunk, size_t limit)
+    : source(source), chunk(std::max<size_t>(chunk, 1)), limit(std::max<size_t>(limit, 1)) { }
+
+bool State::fill(size_t end) {
+    return input->fill(*this, end);
+}
+
+State::State(ChunkedInput &input) : text(input.buffer.data()), index(0), count(0), input(&input) {
+    input.loaded = 0;
+    input.retired.clear();
+    input.retiredSize = 0;
+    input.exhausted = false;
+}
@@ -0,0 +1,173 @@
+#include <crimson/parallel.h>
+
+#include <mutex>
+#include <atomic>
+#include <exception>
+
+std::vector<size_t> splitAfter(std::string_view text, std::string_view delimiter, size_t pieces) {
+    std::vector<size_t> bounds = { 0 };
+
+    size_t size = text.size() / std::max<size_t>(pieces, 1);
+
+    while (bounds.back() < text.size()) {
+        size_t target = bounds.back() + std::max<size_t>(size, 1);
+
+        if (target >= text.size() || delimiter.empty())
+            break;
+
+        size_t found = text.find(delimiter, target);
+
+        if (found == std::string_view::npos)
+            break;
+
+        size_t end = found + delimiter.size();
+
+        if (end >= text.size())
+            break;
+
+        bounds.push_back(end);
+    }
+
+    bounds.push_back(text.size());
+
+    return bounds;
+}
+
+void parallelFor(size_t count, size_t threads, const std::function<void(size_t)> &task) {
+    threads = std::min(std::max<size_t>(threads, 1), count);
+
+    if (threads <= 1) {
+        for (size_t a = 0; a < count; a++)
+            task(a);
+
+        return;
+    }
+
+    std::atomic<size_t> next = 0;
+
+    std::mutex mutex;
+    std::exception_ptr exception;
+
+    auto work = [&]() {
+        try {
+            for (size_t a = next++; a < count; a = next++)
+                task(a);
+        } catch (...) {
+            std::lock_guard lock(mutex);
+
+            if (!exception)
+                exception = std::current_exception();
+
+            next = count;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+
+    for (size_t a = 1; a < threads; a++)
+        workers.emplace_back(work);
+
+    work();
+
+    for (auto &worker : workers)
+        worker.join();
+
+    if (exception)
+        std::rethrow_exception(exception);
+}
+
+size_t WorkerPool::size() const {
+    return threads.size() + 1;
+}
+
+void WorkerPool::run(size_t total, const std::function<void(size_t, size_t)> &function) {
+    {
+        std::lock_guard lock(mutex);
+
+        task = &function;
+        count = total;
+        next = 0;
+        exception = nullptr;
+
+        busy = threads.size();
+        generation++;
+    }
+
+    wake.notify_all();
+
+    work(0);
+
+    std::unique_lock lock(mutex);
+    done.wait(lock, [this] { return busy == 0; });
+
+    task = nullptr;
+
+    if (exception)
+        std::rethrow_exception(std::exchange(exception, nullptr));
+}
+
+void WorkerPool::work(size_t worker) {
+    try {
+        for (size_t a = next++; a < count; a = next++)
+            (*task)(worker, a);
+    } catch (...) {
+        std::lock_guard lock(mutex);
+
+        if (!exception)
+            exception = std::current_exception();
+
+        next = count;
+    }
+}
+
+WorkerPool::WorkerPool(size_t workers) {
+    workers = std::max<size_t>(workers, 1);
+
+    threads.reserve(workers - 1);
+
+    for (size_t a = 1; a < workers; a++) {
+        threads.emplace_back([this, a] {
+            size_t seen = 0;
+
+            while (true) {
+                {
+                    std::unique_lock lock(mutex);
+                    wake.wait(lock, [this, seen] { return stopping || generation != seen; });
+
+                    if (stopping)
+                        return;
+
+                    seen = generation;
+                }
+
+                work(a);
+
+                std::lock_guard lock(mutex);
+
+                if (--busy == 0)
+                    done.notify_one();
+            }
+        });
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+
+    wake.notify_all();
+
+    for (auto &thread : threads)
+        thread.join();
+}
+
+double BatchStats::documentsPerSecond() const {
+    return seconds > 0 ? static_cast<double>(documents) / seconds : 0;
+}
+
+double BatchStats::megabytesPerSecond() const {
+    return seconds > 0 ? static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds : 0;
+}
@@ -0,0 +1,271 @@
+#include <crimson/program.h>
+
+uint32_t ProgramBuilder::label() {
+    labels.push_back(std::numeric_limits<uint32_t>::max());
+
+    return static_cast<uint32_t>(labels.size() - 1);
+}
+
+void ProgramBuilder::bind(uint32_t label) {
+    labels[label] = static_cast<uint32_t>(code.instructions.size());
+}
+
+void ProgramBuilder::emit(Instruction instruction) {
+    code.instructions.push_back(instruction);
+}
+
+void ProgramBuilder::emitNative(Native native) {
+    code.instructions.push_back({ Instruction::Op::Native, Instruction::Mode::Alternative, false, 0,
+        static_cast<uint32_t>(code.natives.size()) });
+    code.natives.push_back(native);
+}
+
+void ProgramBuilder::emitCollect(Native native) {
+    code.instructions.push_back({ Instruction::Op::Collect, Instruction::Mode::Alternative, false, 0,
+        static_cast<uint32_t>(code.natives.size()) });
+    code.natives.push_back(native);
+}
+
+void ProgramBuilder::emitGuard(const FirstSet &first, uint32_t label) {
+    Guard guard { { }, first.literal };
+
+    for (size_t byte = 0; byte < guard.bytes.size(); byte++)
+        guard.bytes.set(byte, first.accepts(static_cast<uint8_t>(byte)));
+
+    if (guard.bytes.all())
+        return;
+
+    code.instructions.push_back({ Instruction::Op::Guard, Instruction::Mode::Alternative, false, label,
+        static_cast<uint32_t>(code.guards.size()) });
+    code.guards.push_back(guard);
+}
+
+uint32_t ProgramBuilder::subroutine(const void *rule, void (*lower)(const void *, ProgramBuilder &)) {
+    auto found = subroutines.find(rule);
+
+    if (found != subroutines.end())
+        return found->second;
+
+    auto result = label();
+
+    subroutines[rule] = result;
+    pending.push_back({ result, rule, lower });
+
+    return result;
+}
+
+ProgramCode ProgramBuilder::finish() {
+    // Subroutines can call more subroutines, so pending grows while this runs.
+    for (size_t a = 0; a < pending.size(); a++) {
+        auto subroutine = pending[a];
+
+        bind(subroutine.label);
+        subroutine.lower(subroutine.rule, *this);
+        emit({ Instruction::Op::Return });
+    }
+
+    for (auto &instruction : code.instructions) {
+        switch (instruction.op) {
+            case Instruction::Op::Choice:
+            case Instruction::Op::Commit:
+            case Instruction::Op::PartialCommit:
+            case Instruction::Op::Call:
+            case Instruction::Op::Jump:
+            case Instruction::Op::Guard:
+                instruction.target = labels[instruction.target];
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return std::move(code);
+}
+
+ProgramStacks &ProgramStacks::of(State &state) {
+    if (!state.stacks)
+        state.stacks = std::make_shared<ProgramStacks>();
+
+    return *state.stacks;
+}
+
+std::unique_ptr<Error> ProgramCode::run(Context &context, ProgramStacks &stacks) const {
+    using Op = Instruction::Op;
+    using Mode = Instruction::Mode;
+
+    auto &state = context.state;
+
+    auto &values = stacks.values;
+    auto &backtracks = stacks.backtracks;
+    auto &frames = stacks.frames;
+    auto &marks = stacks.marks;
+
+    // A run reached from a native of another one stacks on top of it and leaves it as it was.
+    size_t backtrackBase = backtracks.size();
+    size_t frameBase = frames.size();
+    size_t markBase = marks.size();
+
+    uint32_t pc = 0;
+
+    while (true) {
+        const auto &instruction = instructions[pc];
+
+        bool calls = instruction.op == Op::Native || instruction.op == Op::Collect;
+        size_t mark = 0;
+
+        if (instruction.op == Op::Collect) {
+            mark = marks.back();
+            marks.pop_back();
+        }
+
+        // Instructions that call nothing can't fail.
+        std::unique_ptr<Error> error = calls
+            ? natives[instruction.native].call(natives[instruction.native].data, context, values, mark)
+            : nullptr;
+
+        switch (instruction.op) {
+            case Op::Native:
+            case Op::Collect:
+                pc++;
+
+                break;
+
+            case Op::Mark:
+                marks.push_back(values.size());
+                pc++;
+
+                break;
+
+            case Op::Choice:
+                backtracks.push_back({
+                    instruction.target, instruction.mode, context.matched,
+                    state.index, state.recorded(), values.size(), marks.size(), frames.size()
+                });
+
+                // Branch alternatives run in their own context.
+                if (instruction.mode == Mode::Alternative || instruction.mode == Mode::Last)
+                    context.matched = false;
+
+                pc++;
+
+                break;
+
+            case Op::Commit: {
+                auto &entry = backtracks.back();
+
+                if (entry.mode == Mode::Alternative || entry.mode == Mode::Last)
+                    context.matched = entry.matched;
+
+                backtracks.pop_back();
+                pc = instruction.target;
+
+                break;
+            }
+
+            case Op::PartialCommit: {
+                auto &entry = backtracks.back();
+
+                entry.index = state.index;
+                entry.recorded = state.recorded();
+                entry.values = values.size();
+                entry.marks = marks.size();
+
+                pc = instruction.target;
+
+                break;
+            }
+
+            case Op::Call:
+                frames.push_back({ pc + 1, context.matched, instruction.reset });
+
+                if (instruction.reset)
+                    context.matched = false;
+
+                pc = instruction.target;
+
+                break;
+
+            case Op::Return: {
+                auto frame = frames.back();
+                frames.pop_back();
+
+                if (frame.restore)
+                    context.matched = frame.matched;
+
+                pc = frame.ret;
+
+                break;
+            }
+
+            case Op::Jump:
+                pc = instruction.target;
+
+                break;
+
+            case Op::Guard: {
+                const auto &guard = guards[instruction.native];
+
+                if (!state.ensure(state.index + 1) || guard.bytes.test(static_cast<uint8_t>(*state.data(state.index)))) {
+                    pc++;
+
+                    break;
+                }
+
+                if (!guard.literal.empty() && state.index >= state.furthest)
+                    state.fail(state.index, ErrorMustMatchText { guard.literal });
+
+                pc = instruction.target;
+
+                break;
+            }
+
+            case Op::Halt:
+                frames.resize(frameBase);
+                marks.resize(markBase);
+
+                return nullptr;
+        }
+
+        while (error) {
+            if (backtracks.size() == backtrackBase) {
+                frames.resize(frameBase);
+                marks.resize(markBase);
+
+                return error;
+            }
+
+            auto entry = backtracks.back();
+            backtracks.pop_back();
+
+            // matched as it was at the Choice, Many and Maybe share it with what they ran.
+            bool matched = context.matched;
+
+            if (frames.size() > entry.frames)
+                matched = frames[entry.frames].matched;
+
+            if (entry.mode == Mode::Alternative || entry.mode == Mode::Last)
+                matched = entry.matched;
+
+            state.index = entry.index;
+            state.forget(entry.recorded);
+
+            values.erase(values.begin() + static_cast<std::ptrdiff_t>(entry.values), values.end());
+            marks.resize(entry.marks);
+            frames.resize(entry.frames);
+
+            context.matched = matched;
+
+            bool committed = state.committed > entry.index;
+
+            error->matched |= committed;
+
+            bool fails = entry.mode == Mode::Optional ? committed : entry.mode == Mode::Last || error->matched;
+
+            if (!fails) {
+                pc = entry.target;
+                state.recycle(std::move(error));
+            }
+        }
+    }
+}
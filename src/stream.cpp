@@ -0,0 +1,73 @@
+#include <crimson/stream.h>
+
+#include <cstring>
+
+size_t FeedSource::read(char *data, size_t size) {
+    {
+        std::unique_lock lock(mutex);
+
+        ready.wait(lock, [this]() { return offset < pending.size() || finished; });
+
+        size = std::min(size, pending.size() - offset);
+
+        std::memcpy(data, pending.data() + offset, size);
+        offset += size;
+
+        if (offset == pending.size()) {
+            pending.clear();
+            offset = 0;
+        }
+    }
+
+    drained.notify_one();
+
+    return size;
+}
+
+void FeedSource::feed(std::string_view data) {
+    while (!data.empty()) {
+        {
+            std::unique_lock lock(mutex);
+
+            drained.wait(lock, [this]() { return pending.size() - offset < limit || closed; });
+
+            if (closed)
+                return;
+
+            // Read bytes are dropped once they are at least half of pending, so moving the rest costs no more than was read.
+            if (offset >= pending.size() - offset) {
+                pending.erase(0, offset);
+                offset = 0;
+            }
+
+            size_t size = std::min(data.size(), limit - (pending.size() - offset));
+
+            pending.append(data.substr(0, size));
+            data.remove_prefix(size);
+        }
+
+        ready.notify_one();
+    }
+}
+
+void FeedSource::finish() {
+    {
+        std::lock_guard lock(mutex);
+
+        finished = true;
+    }
+
+    ready.notify_one();
+}
+
+void FeedSource::close() {
+    {
+        std::lock_guard lock(mutex);
+
+        closed = true;
+    }
+
+    drained.notify_all();
+}
+
+FeedSource::FeedSource(size_t limit) : limit(std::max<size_t>(limit, 1)) { }
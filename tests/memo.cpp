@@ -0,0 +1,165 @@
+#include <crimson/tools.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Reparses an edited input with the memo table of the previous parse and checks that results,
+// error offsets and the furthest failure match a parse from scratch.
+
+namespace {
+    int failures = 0;
+
+    void check(bool condition, const char *what) {
+        if (!condition) {
+            std::fprintf(stderr, "FAILED: %s\n", what);
+            failures++;
+        }
+    }
+
+    struct Outcome {
+        size_t error;
+        size_t furthest;
+    };
+
+    template <typename T>
+    Outcome parse(const T &rule, const std::string &text, MemoTable *memo) {
+        State state(text);
+        state.memo = memo;
+
+        NotSpace space;
+        AnyHard token;
+        Context context(state, space, token);
+
+        auto result = rule.expose(context);
+
+        return { result.error() ? result.error()->index : std::string::npos, state.failure().index };
+    }
+
+    template <typename T>
+    auto values(const T &rule, const std::string &text, MemoTable *memo) {
+        State state(text);
+        state.memo = memo;
+
+        NotSpace space;
+        AnyHard token;
+        Context context(state, space, token);
+
+        auto result = rule.expose(context);
+
+        using List = std::remove_cvref_t<decltype(std::get<0>(*result.ptr()))>;
+
+        return result.ptr() ? std::get<0>(std::move(*result.ptr())) : List { };
+    }
+
+    template <typename List>
+    std::vector<std::string> texts(const List &list) {
+        return std::vector<std::string>(list.begin(), list.end());
+    }
+}
+
+int main() {
+    auto rule = Rule(Text("x").many(), Rule(Text("a"), Text("b")).memo());
+
+    MemoTable memo;
+
+    std::string text = "x x a c";
+    check(parse(rule, text, &memo).error == 6, "error before the edit");
+
+    text.insert(0, "x ");
+    memo.edit(0, 0, 2);
+
+    check(!memo.entries.empty(), "entries after the edit are kept");
+    auto cached = parse(rule, text, &memo);
+    auto fresh = parse(rule, text, nullptr);
+
+    check(cached.error == fresh.error, "cached error offset is shifted by the edit");
+    check(cached.furthest == fresh.furthest, "cached errors count toward the furthest failure");
+
+    // Words after the edit are found where they moved to instead of being parsed again.
+    size_t runs = 0;
+    auto word = TokenView().map([&runs](auto tuple) { runs++; return std::string(std::get<0>(tuple)); }).memo();
+    auto words = word.many();
+
+    MemoTable shifted;
+
+    text = "alpha beta gamma delta";
+    values(words, text, &shifted);
+
+    text.replace(6, 4, "BETAS");
+    shifted.edit(6, 4, 5);
+
+    check(shifted.segments.size() == 3, "an edit only splits the segments");
+
+    size_t before = runs;
+    auto reused = values(words, text, &shifted);
+
+    check(runs - before <= 2, "words after the edit are reused");
+    check(reused == values(words, text, nullptr), "words after the edit");
+
+    // Anchors are only reused where the edit did not move them.
+    auto anchored = Rule(Anchor(), TokenView()).map([](auto tuple) {
+        return std::to_string(std::get<0>(tuple)) + " " + std::string(std::get<1>(tuple));
+    }).memo().many();
+
+    MemoTable positions;
+
+    text = "one two three";
+    values(anchored, text, &positions);
+
+    text.insert(4, "and ");
+    positions.edit(4, 0, 4);
+
+    check(values(anchored, text, &positions) == values(anchored, text, nullptr), "anchors after the edit");
+
+    // Views point into the old buffer, they are never reused after an edit.
+    auto views = TokenView().memo().many();
+
+    MemoTable buffers;
+
+    {
+        std::string old = "red green blue";
+        values(views, old, &buffers);
+    }
+
+    std::string edited = "red green blue!";
+    buffers.edit(14, 0, 1);
+
+    check(texts(values(views, edited, &buffers)) == texts(values(views, edited, nullptr)), "views after the edit");
+
+    // Many edits before a parse fold the segments back into the entries.
+    for (size_t a = 0; a < MemoTable::maxSegments; a++) {
+        text.insert(0, " ");
+        shifted.edit(0, 0, 1);
+    }
+
+    check(shifted.segments.size() <= MemoTable::maxSegments, "segments are compacted");
+
+    // A hit makes the commit its rule made, so the alternative after it is not tried.
+    auto branch = Rule(Text("x").many(), Branch(
+        Rule(Rule(Text("a"), Cut()).memo(), Text("b")).map([](auto) { return 1; }),
+        Rule(Text("a"), Text("c")).map([](auto) { return 2; })
+    ));
+
+    MemoTable cuts;
+
+    text = "x a c";
+    parse(branch, text, &cuts);
+
+    bool floored = true;
+
+    for (const auto &[key, entry] : cuts.entries)
+        floored &= key.index >= cuts.floor || cuts.find(key) == nullptr;
+
+    check(floored, "entries before the floor are not found");
+
+    text.insert(0, "x ");
+    cuts.edit(0, 0, 2);
+
+    check(parse(branch, text, &cuts).error == parse(branch, text, nullptr).error, "hits replay their commit");
+
+    if (failures == 0)
+        std::puts("memo: ok");
+
+    return failures == 0 ? 0 : 1;
+}
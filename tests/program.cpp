@@ -0,0 +1,179 @@
+#include <crimson/program.h>
+
+#include <new>
+#include <array>
+#include <cstdio>
+#include <string>
+#include <charconv>
+
+// Runs grammars both through their rules and compiled into a program, and checks that results, final
+// indexes, errors and diagnostics agree.
+
+namespace {
+    int failures = 0;
+
+    void check(bool condition, const char *what, std::string_view input) {
+        if (!condition) {
+            std::fprintf(stderr, "FAILED: %s on \"%.*s\"\n", what, static_cast<int>(input.size()), input.data());
+            failures++;
+        }
+    }
+
+    // Room for a recursive rule, Wraps can point at it before the rule it holds is built.
+    template <typename ...Produces>
+    struct Recursive {
+        alignas(AnyRule<Produces...>) std::byte storage[sizeof(AnyRule<Produces...>)];
+        bool defined = false;
+
+        const AnyRule<Produces...> *get() const {
+            return reinterpret_cast<const AnyRule<Produces...> *>(storage);
+        }
+
+        auto wrap() const {
+            return Wrap<Produces...>(get());
+        }
+
+        template <typename T>
+        void define(T &&rule) {
+            new (storage) AnyRule<Produces...>(std::forward<T>(rule));
+            defined = true;
+        }
+
+        Recursive() = default;
+        Recursive(const Recursive &other) = delete;
+
+        ~Recursive() {
+            if (defined)
+                std::launder(reinterpret_cast<AnyRule<Produces...> *>(storage))->~AnyRule();
+        }
+    };
+
+    template <typename Rule, typename Program>
+    void compare(const Rule &rule, const Program &program, std::string_view input, const AnyHard &token) {
+        std::vector<Error> treeDiagnostics;
+        std::vector<Error> programDiagnostics;
+
+        State treeState(input);
+        State programState(input);
+
+        treeState.diagnostics = &treeDiagnostics;
+        programState.diagnostics = &programDiagnostics;
+
+        NotSpace space;
+        Context treeContext(treeState, space, token);
+        Context programContext(programState, space, token);
+
+        auto tree = rule.expose(treeContext);
+        auto compiled = program.expose(programContext);
+
+        check(!tree.ptr() == !compiled.ptr(), "both succeed or both fail", input);
+        check(treeState.index == programState.index, "same final index", input);
+        check(treeDiagnostics.size() == programDiagnostics.size(), "same diagnostics", input);
+
+        if (tree.ptr() && compiled.ptr())
+            check(*tree.ptr() == *compiled.ptr(), "same values", input);
+
+        if (tree.error() && compiled.error()) {
+            check(tree.error()->index == compiled.error()->index, "same error index", input);
+            check(tree.error()->matched == compiled.error()->matched, "same error matched", input);
+            check(tree.error()->reason.index() == compiled.error()->reason.index(), "same error reason", input);
+        }
+    }
+
+    Recursive<uint64_t> expression;
+
+    uint64_t apply(char op, uint64_t left, uint64_t right) {
+        switch (op) {
+            case '+': return left + right;
+            case '-': return left - right;
+            case '*': return left * right;
+            default: return right ? left / right : 0;
+        }
+    }
+
+    template <typename Operand>
+    auto chain(Operand operand, const char *first, const char *second) {
+        auto sign = Pick(
+            Rule(Text(first)).map([first](auto) { return first[0]; }),
+            Rule(Text(second)).map([second](auto) { return second[0]; })
+        );
+
+        auto step = Rule(std::move(sign), Operand(operand)).map([](auto tuple) { return tuple; });
+
+        return Rule(std::move(operand), std::move(step).many()).map([](auto tuple) {
+            auto value = std::get<0>(tuple);
+
+            for (auto [op, operand] : std::get<1>(tuple))
+                value = apply(op, value, operand);
+
+            return value;
+        });
+    }
+}
+
+int main() {
+    AnyHard token;
+
+    auto number = Rule(TokenView()).map([](auto tuple) {
+        auto text = std::get<0>(tuple);
+
+        uint64_t value = 0;
+        std::from_chars(text.data(), text.data() + text.size(), value);
+
+        return value;
+    });
+
+    auto group = Rule(Text("("), expression.wrap(), Text(")")).map([](auto tuple) { return std::get<0>(tuple); });
+
+    expression.define(compilable(chain(chain(Pick(std::move(group), std::move(number)), "*", "/"), "+", "-")));
+
+    auto statements = Rule(expression.wrap(), Text(";")).many();
+    auto statementsProgram = compile(statements);
+
+    for (std::string_view input : { "1+2*3;", "(1+2)*3; 4/2;", "1+;", "((((5))));7-2;", "", "(1+2;", "1 2;", "3*(4+5)-6/2;" })
+        compare(statements, statementsProgram, input, token);
+
+    // Values too big to live inside a box go through the heap.
+    auto wide = Rule(Text("a"), Rule(Text("b"), TokenView()).maybe(), Text("c").maybe(),
+        BranchSome(Rule(Text("x")), Rule(Text("y"), TokenView())))
+        .map([](auto tuple) {
+            std::array<uint64_t, 8> values { };
+            values[0] = std::get<0>(tuple).has_value();
+            values[1] = std::get<1>(tuple).has_value();
+            values[7] = std::get<2>(tuple).index();
+
+            return values;
+        });
+
+    auto wideProgram = compile(wide);
+
+    for (std::string_view input : { "a b q y z", "a c x", "a y", "a b", "a" })
+        compare(wide, wideProgram, input, token);
+
+    auto statement = Rule(TokenView(), Text("="), TokenView()).map([](auto t) { return std::string(std::get<0>(t)); });
+    auto block = Rule(Text("{"), Rule(std::move(statement).recover({ ";" }), Text(";")).many(), Text("}"));
+    auto blockProgram = compile(block);
+
+    AnyHard blockToken({ '=', ';', '{', '}' });
+
+    for (std::string_view input : { "{ a = b ; c = d ; }", "{ a b ; c = d ; }", "{ a = b ; c d }", "{ }" })
+        compare(block, blockProgram, input, blockToken);
+
+    // Nesting bounded by the heap instead of the native stack.
+    std::string deep = std::string(200000, '(') + "1" + std::string(200000, ')') + ";";
+
+    {
+        State state(deep);
+        NotSpace space;
+        Context context(state, space, token);
+
+        auto result = statementsProgram.expose(context);
+
+        check(result.ptr() && state.index == deep.size(), "deep nesting parses", "(((...1...)));");
+    }
+
+    if (failures == 0)
+        std::puts("program: ok");
+
+    return failures == 0 ? 0 : 1;
+}
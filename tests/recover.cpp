@@ -0,0 +1,67 @@
+#include <crimson/tools.h>
+
+#include <cstdio>
+#include <string>
+
+// Recovers statements inside a block whose closer is not one of the stops, and checks that rules which
+// backtrack over a recovered statement drop its diagnostic.
+
+namespace {
+    int failures = 0;
+
+    void check(bool condition, const char *what) {
+        if (!condition) {
+            std::fprintf(stderr, "FAILED: %s\n", what);
+            failures++;
+        }
+    }
+
+    struct Outcome {
+        bool ok;
+        std::vector<Error> diagnostics;
+    };
+
+    template <typename T>
+    Outcome parse(const T &rule, const std::string &text) {
+        State state(text);
+
+        Outcome outcome;
+        state.diagnostics = &outcome.diagnostics;
+
+        NotSpace space;
+        AnyHard token({ '=', ';', '{', '}' });
+        Context context(state, space, token);
+
+        outcome.ok = rule.expose(context).ptr() && state.index == text.size();
+
+        return outcome;
+    }
+}
+
+int main() {
+    auto statement = Rule(TokenView(), Text("="), TokenView()).map([](auto t) { return std::string(std::get<0>(t)); });
+    auto block = Rule(Text("{"), Rule(std::move(statement).recover({ ";" }), Text(";")).many(), Text("}"));
+
+    auto clean = parse(block, "{ a = b ; c = d ; }");
+    check(clean.ok, "clean block parses");
+    check(clean.diagnostics.empty(), "clean block leaves no diagnostics");
+
+    auto broken = parse(block, "{ a b ; c = d ; }");
+    check(broken.ok, "broken block parses");
+    check(broken.diagnostics.size() == 1, "broken statement is recorded once");
+    check(!broken.diagnostics.empty() && broken.diagnostics.front().index == 4, "diagnostic points at the error");
+
+    auto closed = parse(block, "{ a = b ; c d }");
+    check(!closed.ok, "a statement running into the closer fails the block");
+    check(closed.diagnostics.empty(), "failed block leaves no diagnostics");
+
+    auto optional = Rule(TokenView(), Text("=")).recover({ ";" });
+    auto backtracked = parse(Rule(Rule(std::move(optional), Text("!")).maybe(), TokenView(), TokenView(), Text(";")), "a b ;");
+    check(backtracked.ok, "maybe backtracks over the recovered rule");
+    check(backtracked.diagnostics.empty(), "backtracking forgets the diagnostic");
+
+    if (failures == 0)
+        std::puts("recover: ok");
+
+    return failures == 0 ? 0 : 1;
+}
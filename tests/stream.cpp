@@ -0,0 +1,146 @@
+#include <crimson/stream.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/socket.h>
+
+// Feeds fragments to a StreamParser through a socketpair and checks that every item is delivered as soon as
+// the bytes deciding it have arrived, and not before.
+
+namespace {
+    int failures = 0;
+
+    void check(bool condition, const char *what, size_t step) {
+        if (!condition) {
+            std::fprintf(stderr, "FAILED at fragment %zu: %s\n", step, what);
+            failures++;
+        }
+    }
+
+    // Waits until count reaches expected or a second passed.
+    bool reaches(const std::atomic<size_t> &count, size_t expected) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+
+        while (count.load() < expected && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        return count.load() >= expected;
+    }
+}
+
+int main() {
+    int fds[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        std::perror("socketpair");
+
+        return 1;
+    }
+
+    auto item = Rule(TokenView(), Text(";")).map([](auto tuple) { return std::string(std::get<0>(tuple)); });
+
+    NotSpace space;
+    AnyHard token({ ';' });
+
+    std::vector<std::string> items;
+    std::atomic<size_t> delivered = 0;
+
+    StreamParser parser(item, space, token, [&items, &delivered](std::string text) {
+        items.push_back(std::move(text));
+        delivered++;
+    }, 4);
+
+    // Moves whatever arrives on the socket into the parser until the writing end closes.
+    std::thread pump([&parser, fd = fds[1]]() {
+        char buffer[3];
+        ssize_t size;
+
+        while ((size = read(fd, buffer, sizeof(buffer))) > 0)
+            parser.feed(std::string_view(buffer, static_cast<size_t>(size)));
+    });
+
+    // An item is decided once the first byte after its ";" and trailing spaces has been seen.
+    struct Fragment {
+        const char *text;
+        size_t delivered;
+    };
+
+    std::vector<Fragment> fragments = {
+        { "alpha ; be", 1 },
+        { "ta ; gam", 2 },
+        { "ma", 2 },
+        { " ; ", 2 },
+        { "delta ;", 3 },
+        { " epsilon", 4 },
+        { " ;", 4 },
+    };
+
+    for (size_t a = 0; a < fragments.size(); a++) {
+        std::string_view text = fragments[a].text;
+
+        check(write(fds[0], text.data(), text.size()) == static_cast<ssize_t>(text.size()), "write", a);
+
+        check(reaches(delivered, fragments[a].delivered), "item not delivered once decided", a);
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        check(delivered.load() == fragments[a].delivered, "item delivered before it was decided", a);
+    }
+
+    close(fds[0]);
+    pump.join();
+
+    auto result = parser.finish();
+    close(fds[1]);
+
+    check(result.ptr() != nullptr, "parse failed", fragments.size());
+    check(items == std::vector<std::string> { "alpha", "beta", "gamma", "delta", "epsilon" }, "items", fragments.size());
+
+    // On a thread the caller supplies, with a limit far below the input so feed has to wait for the parse.
+    std::thread runner;
+    FeedSource *watched = nullptr;
+
+    size_t counted = 0;
+    bool bounded = true;
+
+    StreamParser limited(item, space, token, [&counted, &bounded, &watched](std::string) {
+        std::lock_guard lock(watched->mutex);
+
+        bounded &= watched->pending.size() - watched->offset <= 64;
+        counted++;
+    }, 4, 64, [&runner](std::function<void()> work) { runner = std::thread(std::move(work)); });
+
+    watched = &limited.source;
+
+    std::string many;
+
+    for (size_t a = 0; a < 1000; a++)
+        many += "item" + std::to_string(a) + " ; ";
+
+    limited.feed(many);
+
+    auto outcome = limited.finish();
+    runner.join();
+
+    check(outcome.ptr() != nullptr, "limited parse failed", 0);
+    check(counted == 1000, "limited items", 0);
+    check(bounded, "feed buffered more than its limit", 0);
+
+    // A failed parse reports the furthest failure, not the error of the last alternative tried.
+    auto statement = Branch(Rule(Text("let"), TokenView(), Text(";")), Rule(Text("x"), TokenView()));
+
+    StreamParser failing(statement, space, token, [](auto) { });
+    failing.feed("let a b");
+
+    auto failed = failing.finish();
+    check(failed.error() && failed.error()->index == 6, "failure reports the furthest error", 0);
+
+    if (failures == 0)
+        std::puts("stream: ok");
+
+    return failures == 0 ? 0 : 1;
+}